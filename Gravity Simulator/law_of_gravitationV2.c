@@ -10,9 +10,27 @@ Start Date: 24/10/2025
 #include <stdlib.h>
 #include <math.h>
 #include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
 #include <windows.h>
 
-#define FRAME_BUFFER_SIZE 20000
+// vector kernels are built with per-function target attributes and picked at runtime
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SIMD_KERNELS
+#include <immintrin.h>
+#endif
+
+// the force passes are threaded when built with -fopenmp and run on one thread otherwise. Their
+// directives go through OMP_PRAGMA, which leaves nothing behind without OpenMP
+#ifdef _OPENMP
+#include <omp.h>
+#define OMP_PRAGMA(...) _Pragma(#__VA_ARGS__)
+#else
+#define OMP_PRAGMA(...)
+#endif
+
+#define FRAME_BUFFER_SIZE (200 * 200 * 16 + 1024) // every pixel at its longest escape sequence plus the header
 
 // time units in seconds
 #define MINUTE (60)
@@ -21,16 +39,17 @@ Start Date: 24/10/2025
 #define WEEK (DAY * 7)
 
 // simulation constants
-#define NO_OBJECTS 3
+_Thread_local int no_objects = 3; // number of bodies, set when a scenario is loaded
 const double GRAVITATIONAL_CONSTANT = 6.67430e-11;
 #define M_PI 3.14159265358979323846
 #define DEG_TO_RAD (M_PI / 180.0)
 #define RAD_TO_DEG (180.0 / M_PI)
 
-// simulation configuration
-int delta_time = MINUTE;     // simulaton step duration
-int log_step = MINUTE;       // how often data is recorded
-int time_scale = (WEEK * 4); // total duration of the simulation
+// simulation configuration, per thread like the other settings and counters of a single run,
+// so a parameter sweep can run several with different settings at once
+_Thread_local int delta_time = MINUTE;     // simulaton step duration
+_Thread_local int log_step = MINUTE;       // how often data is recorded
+_Thread_local int time_scale = (WEEK * 4); // total duration of the simulation
 
 // derived intervals
 #define MINUTE_INTERVAL (MINUTE / delta_time)
@@ -38,6 +57,157 @@ int time_scale = (WEEK * 4); // total duration of the simulation
 #define DAY_INTERVAL (DAY / delta_time)
 #define WEEK_INTERVAL (WEEK / delta_time)
 
+// enum for force solvers
+enum Force_engines
+{
+    DIRECT,        // exact O(N^2) pair sum, the reference mode
+    BARNES_HUT,    // O(N log N) octree approximation
+    PARTICLE_MESH, // O(N + M^3 log M) potential on a grid, for very many bodies
+    FMM            // fast multipole method on the octree, far fewer translations than Barnes-Hut walks
+};
+
+// force solver configuration
+int force_engine = DIRECT;   // which solver apply_gravitational_forces_N uses
+double opening_angle = 0.5;  // Barnes-Hut theta, a chunk is treated as one body when size / distance < theta
+#define CHUNK_CAPACITY 8     // most bodies a chunk holds before it is split into children
+#define MAX_CHUNK_DEPTH 48   // stops splitting (near) coincident bodies forever
+int mesh_size = 64;          // particle mesh cells per side, a power of two
+#define MAX_MESH_SIZE 256
+int fmm_order = 4;           // highest degree of the fast multipole expansions, uses opening_angle too
+#define MAX_FMM_ORDER 10
+#define FMM_PAIR_COST 8      // rough cost of one body pair in multiply-adds of a multipole to local translation
+#define FMM_TASK_BODIES 2048 // chunks with fewer bodies are walked by the thread that reaches them
+#define MAX_FMM_TERMS ((MAX_FMM_ORDER + 1) * (MAX_FMM_ORDER + 2) * (MAX_FMM_ORDER + 3) / 6)
+
+// bodies lighter than this fraction of the heaviest body are test particles, they feel the
+// massive bodies but pull on nothing, so a pass costs massive x all instead of all x all
+double test_particle_ratio = 1e-15;
+
+// enum for the instruction sets the direct solver can use
+enum Simd_levels
+{
+    SIMD_SCALAR,
+    SIMD_SSE2,   // 2 bodies per instruction
+    SIMD_AVX2,   // 4 bodies per instruction
+    SIMD_AVX512  // 8 bodies per instruction
+};
+
+int simd_level = SIMD_SCALAR; // widest instruction set the cpu supports, set by init_simd
+
+// enum for the integrators that advance the bodies
+enum Integrators
+{
+    EULER,       // first order semi-implicit Euler with one global delta_time
+    LEAPFROG,    // second order symplectic kick-drift-kick
+    YOSHIDA,     // fourth order symplectic, leapfrog composed as a triple jump
+    FOREST_RUTH, // fourth order symplectic, drift-kick-drift composed as a triple jump
+    HERMITE,     // fourth order Hermite with per body block time steps
+    RADAU,       // adaptive 15th order Gauss-Radau, IAS15 style
+    WISDOM_HOLMAN, // Kepler orbits around body 0 solved exactly, the other pulls as kicks
+    RESPA,       // leapfrog with far pulls kicked less often than near ones
+    NO_INTEGRATORS
+};
+
+// integrator configuration
+int integrator = EULER;
+int block_step_max = DAY;        // longest Hermite block step in seconds, steps are this halved 0 to MAX_BLOCK_LEVEL times
+double hermite_accuracy = 0.01;  // Aarseth time step parameter, smaller is more accurate
+#define HERMITE_START_ACCURACY 0.01
+#define MAX_BLOCK_LEVEL 40
+_Thread_local long long hermite_force_evaluations = 0; // bodies corrected so far, a measure of the work done
+double radau_accuracy = 1e-9;    // Gauss-Radau error allowed per step relative to the acceleration
+#define RADAU_SAFETY 0.25        // steps shrink below this ratio are redone, and grow at most its inverse
+#define RADAU_CONVERGENCE 1e-16  // predictor-corrector stops once b7 changes less than this
+#define RADAU_MAX_ITERATIONS 12
+#define RADAU_MIN_STEP 1e-6      // seconds
+#define RADAU_MAX_FLOOR_STEPS 16 // steps in a row at RADAU_MIN_STEP, taken or redone, before the run is given up
+#define RADAU_FINEST_ACCURACY 1e-10 // refining goes no further, much below it the error estimate is mostly roundoff
+#define KEPLER_MAX_ITERATIONS 50
+
+// enum for how update moves a body with the Euler integrator
+enum Propagation_modes
+{
+    PROPAGATE_DIRECT, // Euler on the full acceleration
+    PROPAGATE_ENCKE   // Euler on the deviation from a Kepler conic around body 0
+};
+
+double encke_threshold = 0.0; // bodies perturbed less than this fraction of their pull towards body 0 use Encke, 0 is off
+#define ENCKE_RECTIFY 0.01     // a new conic starts once the deviation is this fraction of the distance to body 0
+
+double respa_cutoff = 1e8;      // metres, pairs further apart than this only get far kicks
+int respa_substeps = 10;        // near kicks of delta_time per far kick
+#define RESPA_SWITCH_START 0.7  // fraction of the cutoff where the near share starts to fall
+#define RESPA_LIST_MARGIN 1.5   // bodies within this many cutoffs go on each other's neighbour lists
+_Thread_local long long force_passes = 0; // force passes done by the last simulation
+
+struct Body_store;
+
+// pluggable integrator behind simulate, either stepping by delta_time or advancing itself
+typedef struct Integrator
+{
+    char *name;
+    void (*start)(struct Body_store *);                              // called once before the first step
+    void (*step)(struct Body_store *, double dt);                    // one fixed step, or NULL
+    bool (*advance)(struct Body_store *, double from, double to);    // own stepping between two times, or NULL, false if it could not get there
+    bool forces_at_end;                                              // the accelerations left behind are those at the final positions
+} Integrator;
+
+// threading configuration
+_Thread_local int thread_count = 1; // threads used by the force passes, set to every core by init_threads
+#define PARALLEL_MIN_BODIES 256  // below this many bodies threading costs more than it saves
+
+// reproducible mode configuration
+bool reproducible = false;     // direct forces come out bit for bit the same on any thread count and instruction set
+#define REPRODUCIBLE_LANES 8   // partial sums per body, the widest vector, summed as a fixed tree at the end
+
+// enum for what the conservation monitor does once the energy drifts too far
+enum Monitor_actions
+{
+    MONITOR_SHOW,   // only show the drift in the render header
+    MONITOR_ABORT,  // stop the simulation at the log step where it happened
+    MONITOR_REFINE  // start again with half the step, up to MAX_REFINEMENTS times
+};
+
+// conservation monitor configuration
+int monitor_step = HOUR;          // seconds between samples of the conserved totals, rounded up to whole log steps
+double drift_threshold = 1e-6;    // energy change relative to the starting energy that counts as too far
+int monitor_action = MONITOR_SHOW;
+#define MAX_REFINEMENTS 6
+
+// checkpoint configuration
+_Thread_local int checkpoint_step = 0; // seconds of simulated time between checkpoints, rounded up to whole log steps, 0 is off
+#define CHECKPOINT_PATH_LENGTH 260
+char checkpoint_path[CHECKPOINT_PATH_LENGTH] = "simulation.checkpoint";
+#define CHECKPOINT_MAGIC "GRAVCKPT"
+#define CHECKPOINT_VERSION 5
+#define MAX_CHECKPOINT_SECTIONS 40
+
+// enum for how the simulation log keeps positions and velocities
+enum Log_formats
+{
+    LOG_DOUBLE,   // exactly as simulated
+    LOG_FLOAT,    // float offsets from where each body is at the start of its chunk, half the size
+    LOG_CHEBYSHEV // Chebyshev series fitted to stretches of rows, within log_tolerance of every logged position
+};
+
+// simulation log configuration
+int log_format = LOG_DOUBLE;
+double log_tolerance = 1000.0;  // metres a fitted position may be from the simulated one in LOG_CHEBYSHEV
+#define CHEBYSHEV_DEGREE 12     // highest degree of a fitted series
+#define CHEBYSHEV_WINDOW 1024   // most rows fitted at once, they are split in halves until every body fits
+#define CHEBYSHEV_PENDING_SIZE (16 << 20) // bytes the rows waiting to be fitted may take, fewer rows are fitted at once past it
+#define TRAIL_SAMPLES 40320       // points along a trail when the log has fewer rows, a four week run logged every minute
+
+// sizes with their own unrolled kernels
+#define MAX_SMALL_N 16
+#define SMALL_UNROLL_LIMIT 12  // above this the fully unrolled pair loops outgrow the instruction cache
+
+// ensemble configuration
+double ensemble_spread = 1e-3;  // most a variant changes each position and velocity component, as a fraction of it
+#define ENSEMBLE_LANE_WIDTH 8   // variants are padded to whole vectors of the widest kernel
+#define ENSEMBLE_BLOCK 64       // lanes a thread takes through a whole run, small enough to stay in cache
+#define SMALL_SIZES(X) X(2) X(3) X(4) X(5) X(6) X(7) X(8) X(9) X(10) X(11) X(12) X(13) X(14) X(15) X(16)
+
 // enum for plane axes
 enum Planes
 {
@@ -82,6 +252,349 @@ typedef struct
 
 } Object;
 
+typedef struct Chunk
+{
+    struct Chunk *child[2][2][2];
+
+    Vec3 centre;         // geometric centre of the cube
+    double half_size;    // half the side length of the cube
+    Vec3 centre_of_mass;
+    double mass;         // total mass of every body inside
+
+    int first;           // first body of this chunk in octree.order
+    int count;           // number of bodies inside
+    bool leaf;
+
+} Chunk;
+
+// octree rebuilt every step by the Barnes-Hut solver
+typedef struct
+{
+    Chunk *pool;     // every chunk of the tree, pool[0] is the root
+    int pool_size;
+    int used;
+
+    int *order;      // body indices sorted so each chunk owns a contiguous range
+    int *slot;       // position of each body inside order
+    int *octant;     // octant of each body while its chunk is split
+    int *sorted;     // partition buffer
+    int no_bodies;
+} Octree;
+
+// particle mesh workspace, the grid is padded to twice mesh_size per side for isolated boundaries
+typedef struct
+{
+    int size;
+    int padded;
+    double *grid;    // padded^3 complex values, the mass and then the potential
+    double *green;   // padded^3 transform of the Green's function, which is real
+    double *field;   // x, y and z accelerations at the size^3 nodes
+    double *twiddle; // FFT roots of unity for the padded length
+} Mesh;
+
+// fast multipole workspace, expansions are indexed by a chunk's place in the octree pool
+typedef struct
+{
+    int order;       // expansion order the tables below are built for
+    int terms;       // multi-indices alpha with |alpha| <= order
+    int direct_pairs; // chunk pairs with at most this many body pairs are summed directly
+    int *power;      // x, y and z powers of every term, in order of degree
+    int *index;      // term with powers x, y, z at [(x * (order + 1) + y) * (order + 1) + z]
+    int *sum;        // term alpha + beta at [alpha * terms + beta], -1 past the order
+    double *m2l;     // (-1)^|alpha| (alpha + beta choose alpha) at [alpha * terms + beta]
+    double choose[MAX_FMM_ORDER + 1][MAX_FMM_ORDER + 1];
+
+    int chunks;        // chunks the expansions have room for
+    double *multipole; // sum(gm * d^alpha) about each chunk's centre of mass
+    double *local;     // Taylor coefficients of the potential about each chunk's centre of mass
+    double *radius;    // furthest body from each chunk's centre of mass
+} Fmm;
+
+// hermite block time step state, kept per body
+typedef struct
+{
+    int count;
+
+    // corrected state of each body at its own time
+    double *position_x, *position_y, *position_z;
+    double *velocity_x, *velocity_y, *velocity_z;
+    double *jerk_x, *jerk_y, *jerk_z;
+
+    // acceleration and jerk from the latest force pass
+    double *new_acceleration_x, *new_acceleration_y, *new_acceleration_z;
+    double *new_jerk_x, *new_jerk_y, *new_jerk_z;
+
+    long long *time;  // each body's own time in ticks
+    int *level;       // each body's step is 2^(MAX_BLOCK_LEVEL - level) ticks
+    int *active;      // bodies corrected in the current block
+
+    long long now;    // time of the latest block in ticks
+    double tick;      // seconds per tick
+} Block_steps;
+
+// gauss-radau state, every array holds 3 components per body
+typedef struct
+{
+    int components;
+    double *block; // one allocation for all the arrays below
+
+    double *x0, *v0, *a0;                     // state at the start of the step
+    double *x1, *v1, *a1;                     // state at the end of the last step, while the bodies are set to a log time inside it
+    double *compensation_x, *compensation_v;  // Kahan sums of the position and velocity
+    double *g[7];                             // divided differences of the acceleration
+    double *b[7];                             // polynomial coefficients of the acceleration
+    double *dense[7];                         // b of the last accepted step, for the state at any time inside it
+
+    double step;      // next step in seconds
+    double time;      // seconds reached, past the bodies' time when the last step ran beyond it
+    double last_step; // length of the last accepted step
+} Radau_state;
+
+#define RADAU_ARRAYS 29
+
+// wisdom-holman state
+typedef struct
+{
+    int count;
+    double *kick_x, *kick_y, *kick_z; // interaction accelerations, kept so a step needs one force pass
+} Wisdom_holman_state;
+
+// encke state, per body
+typedef struct
+{
+    int count;
+    int *mode;          // enum Propagation_modes
+    double *reference;  // position and velocity relative to body 0 at the last rectification, 6 per body
+    double *deviation;  // position and velocity away from the reference conic, 6 per body
+    double *elapsed;    // seconds since the last rectification
+    int no_encke;       // bodies using Encke
+    long long rectifications;
+} Encke_state;
+
+// respa state
+typedef struct
+{
+    int count;
+    double *near_x, *near_y, *near_z; // near part of the accelerations
+    double *far_x, *far_y, *far_z;    // far part, kept from the last full force pass
+    double *listed_x, *listed_y, *listed_z; // positions when the neighbour lists were built
+    int *first;                       // body i's neighbours are neighbours[first[i] .. first[i + 1])
+    int *neighbours;                  // bodies close enough to have a near part, in index order
+    int neighbour_capacity;
+} Respa_state;
+
+// every setting that changes how a run turns out, saved in checkpoints and kept with the live state
+typedef struct
+{
+    int delta_time, log_step, time_scale;
+    int integrator, force_engine, mesh_size, fmm_order, block_step_max, respa_substeps;
+    double opening_angle, test_particle_ratio, hermite_accuracy, radau_accuracy, encke_threshold, respa_cutoff;
+    bool reproducible;
+    int monitor_step, monitor_action, checkpoint_step;
+    double drift_threshold;
+    int log_format;
+    double log_tolerance;
+} Run_settings;
+
+// structure of arrays holding the live state of every body, so hot loops only stream the fields they use
+typedef struct Body_store
+{
+    int count;
+
+    double *position_x, *position_y, *position_z;
+    double *velocity_x, *velocity_y, *velocity_z;
+    double *acceleration_x, *acceleration_y, *acceleration_z;
+
+    double *mass;
+    double *gm;     // GRAVITATIONAL_CONSTANT * mass, precomputed for the force loops, 0 for test particles
+    char *symbol;
+
+    int massive_count; // bodies 0 .. massive_count - 1 pull on the others, the rest are test particles
+
+    int time;              // seconds the bodies have been advanced to, the log is complete up to here
+    Run_settings settings; // what they were advanced with, a run is only carried on with the same
+
+    // per-thread x, y and z accelerations of the parallel direct pass, reduced into acceleration_*
+    double *thread_acceleration;
+    int thread_buffers;
+
+    Block_steps blocks;
+    Radau_state radau;
+    Wisdom_holman_state wisdom_holman;
+    Encke_state encke;
+    Respa_state respa;
+
+    // force solver workspaces, one set per body store so separate runs can go at the same time
+    Octree octree;
+    Mesh mesh;
+    Fmm fmm;
+} Body_store;
+
+#define BODY_STORE_ARRAYS 11 // double arrays in a body store
+
+// a stretch of the simulation log fitted with Chebyshev series, every body over the same rows
+typedef struct
+{
+    size_t first_row;     // the last row is also the first of the next segment, so every time between rows is in one
+    int rows;
+    int degree;
+    double *coefficients; // [body][component][degree + 1], in the log's chunks
+} Log_segment;
+
+// simulation log, grown a chunk at a time as the simulation runs. Rows never move once written,
+// so a row is found from its index alone and a checkpoint can write them while the run carries on.
+// The mass and symbol of each body are kept once, and a chunk keeps every position in one stream
+// and every velocity in another, so drawing trails only reads positions. Each chunk starts with
+// the origin its float offsets are from, every body's position and velocity in its first row.
+// In LOG_CHEBYSHEV the chunks hold the coefficients of the segments instead
+typedef struct
+{
+    char **chunks;      // chunk_size bytes each, page aligned, allocated the first time they are written to
+    int no_chunks;
+    int chunk_capacity; // room in chunks
+    size_t chunk_size;
+    int chunk_rows;
+    int count;          // bodies in each row
+    size_t rows;        // rows written, the last one is the latest logged time
+    int format;         // a Log_formats, fixed when a run starts
+    size_t value_size;  // bytes in one position or velocity component
+    double *mass;       // per body, the same in every row
+    char *symbol;
+    Object *row;        // one row put back together by get_log_data
+
+    // LOG_CHEBYSHEV
+    double tolerance;
+    Log_segment *segments;
+    int no_segments;
+    int segment_capacity;
+    int chunk_in_use;       // chunk the next coefficients go in
+    size_t chunk_used;      // bytes of it already taken
+    Vec3 *pending_position; // [row][body], the rows since the last segment, which are not fitted yet
+    Vec3 *pending_velocity;
+    size_t first_pending;   // row the pending ones start at
+    int no_pending;
+    int window;             // rows fitted at once, there is room for one more pending
+} Simulation_log;
+
+#define LOG_CHUNK_SIZE (1 << 20) // bytes in each chunk of the simulation log, unless one row is bigger
+#define LOG_STREAMS 2            // positions and velocities
+
+// variants of one scenario side by side, every array is [body][lane]
+typedef struct
+{
+    int count;     // bodies in each variant
+    int variants;
+    int lanes;     // variants rounded up to a whole number of the widest vectors
+
+    double *position_x, *position_y, *position_z;
+    double *velocity_x, *velocity_y, *velocity_z;
+    double *acceleration_x, *acceleration_y, *acceleration_z;
+
+    double *mass;
+    double *gm;
+    char *symbol;  // one per body, the same in every variant
+
+    Simulation_log log; // every variant's rows, body i of variant v is body v * count + i of the log
+} Ensemble;
+
+#define ENSEMBLE_ARRAYS 11 // double arrays in an ensemble
+
+// one run of a sweep, settings first and results after the run
+typedef struct
+{
+    int delta_time;
+    int log_step;            // what the run logs at, the asked for log step raised to delta_time if it is shorter
+    int asked_log_step;      // runs are compared with the others that asked for the same log step
+    int variant;
+
+    Object *final_objects;   // state at the last log step, count objects
+    double final_error;      // metres, furthest any body ends up from the reference run, < 0 for the reference itself
+                             // and NAN if the two last log steps are at different times
+    double energy_drift;     // largest relative change of the total energy at any log step
+    double wall_time;        // seconds
+    long long force_passes;  // object steps for Hermite, which has no whole force passes
+} Sweep_run;
+
+// conserved totals of the massive bodies at one time, and how far they have moved from the first sample
+typedef struct
+{
+    int time;                   // seconds
+    double energy;              // joules, kinetic plus potential
+    double momentum[3];
+    double angular_momentum[3]; // about the centre of mass
+    double momentum_scale;      // sums of the magnitudes of each body's share, so a drift of 0 momentum still has a size
+    double angular_scale;
+    double energy_drift;        // relative to the first sample
+    double momentum_drift;
+    double angular_drift;
+} Conservation;
+
+// samples of the last simulation, grown with it like the simulation log
+typedef struct
+{
+    Conservation *samples;
+    int no_samples;
+    int capacity;
+    int every;                  // log steps between samples
+    int refinements;            // times the step was halved by MONITOR_REFINE
+    bool stopped;               // the drift passed drift_threshold and the simulation stopped there
+    bool failed;                // or the integrator could not keep to its accuracy and stopped it
+    double *saved_x, *saved_y, *saved_z; // the integrator's accelerations, kept aside during a monitor force pass
+} Monitor;
+
+// start of a checkpoint file, the settings and counters of the run, followed by every checkpoint
+// section in order and then the log rows up to time
+typedef struct
+{
+    char magic[8];              // CHECKPOINT_MAGIC, without the terminator
+    int version;
+    int count;
+    int time;                   // seconds simulated, the log is complete up to here
+    Run_settings settings;
+
+    int no_samples, monitor_every, refinements;
+    long long force_passes, hermite_force_evaluations;
+} Checkpoint_header;
+
+// one contiguous piece of the state a checkpoint holds
+typedef struct
+{
+    void *data;
+    size_t size;
+} Checkpoint_section;
+
+// checkpoint being written in the background
+typedef struct
+{
+    HANDLE thread;        // NULL when no write is going on
+    char *buffer;         // the header and every section, copied so the simulation can carry on
+    size_t size;
+    size_t capacity;
+    Simulation_log log;   // the log as far as the checkpoint with its own chunk list, rows never change once written
+    int log_chunk_capacity;
+    char path[CHECKPOINT_PATH_LENGTH];
+    bool failed;
+} Checkpoint_writer;
+
+
+// one block of memory sized when a scenario is loaded
+typedef struct
+{
+    char *base;
+    size_t size;
+    size_t used;
+} Arena;
+
+#define ARENA_ALIGNMENT 64 // cache line, also keeps vector loads aligned
+
+// enum for the scenarios that can be loaded
+enum Scenarios
+{
+    EARTH_MOON_SATELLITE,
+    CLUSTER,
+    CONSTELLATION
+};
+
 typedef struct 
 {
     int trail_pixel_position;
@@ -120,11 +633,9 @@ typedef struct
 } Camera;
 
 
-typedef struct Chunk
-{
-    struct Chunk *child[2][2][2];
 
-} Chunk;
+// in the same order as enum Force_engines
+char *force_engine_names[] = {"Direct", "Barnes-Hut", "Particle mesh", "Fast multipole"};
 
 
 
@@ -147,28 +658,253 @@ Camera camera = {
 Vec3 degrees = (Vec3){0, 0, 0};
 // x and z verified
 
+// arena
+void init_arena(Arena *, size_t size);
+void *arena_alloc(Arena *, size_t size);
+
+// scenarios
+Simulation_log *load_scenario(Arena *, int scenario, int count, Object **initial_objects, Body_store *);
+Simulation_log *init_scenario(Arena *, int count, Object **initial_objects, Body_store *);
+void create_scenario(Object[], int scenario, int count);
+void perturb_objects(Object[], int count, int variant);
+double random_signed(uint64_t *state);
+void create_earth_moon_satellite(Object[]);
+void create_cluster(Object[], int count);
+void create_constellation(Object[], int count);
+void sort_test_particles(Object[], int count);
+
+// body store
+void init_bodies(Body_store *, int count, Arena *);
+void free_bodies(Body_store *);
+void load_bodies(Body_store *, Object[]);
+Object get_body(Body_store *, int i);
+
 // core physics
 double distance(Object, Object);
-void apply_gravitational_forces(Object *, Object *);
-void apply_gravitational_forces_N(Object[]);
+double total_energy(Object[], int count);
+Vec3 object_force(Object[], int count, int i);
+void apply_gravitational_forces(Body_store *, int i, int j, double *ax, double *ay, double *az);
+void apply_gravitational_forces_N(Body_store *);
+void apply_gravitational_forces_direct(Body_store *);
+
+// vector kernels
+typedef void (*Gravity_row_kernel)(Body_store *, int i, int j_start, int j_end, double *ax, double *ay, double *az);
+void gravity_row_scalar(Body_store *, int i, int j_start, int j_end, double *ax, double *ay, double *az);
+void gravity_row_sse2(Body_store *, int i, int j_start, int j_end, double *ax, double *ay, double *az);
+void gravity_row_avx2(Body_store *, int i, int j_start, int j_end, double *ax, double *ay, double *az);
+void gravity_row_avx512(Body_store *, int i, int j_start, int j_end, double *ax, double *ay, double *az);
+void init_simd();
+Gravity_row_kernel gravity_row = gravity_row_scalar;
+
+// small n kernels, indexed by body count
+#define SMALL_KERNEL_PROTOTYPES(N) void small_forces_##N(Body_store *); void small_leapfrog_##N(Body_store *, double dt);
+SMALL_SIZES(SMALL_KERNEL_PROTOTYPES)
+#undef SMALL_KERNEL_PROTOTYPES
+bool small_kernel_fits(Body_store *);
+#define SMALL_FORCES_ENTRY(N) [N] = small_forces_##N,
+#define SMALL_LEAPFROG_ENTRY(N) [N] = small_leapfrog_##N,
+void (*small_force_kernels[MAX_SMALL_N + 1])(Body_store *) = {SMALL_SIZES(SMALL_FORCES_ENTRY)};
+void (*small_leapfrog_kernels[MAX_SMALL_N + 1])(Body_store *, double) = {SMALL_SIZES(SMALL_LEAPFROG_ENTRY)};
+#undef SMALL_FORCES_ENTRY
+#undef SMALL_LEAPFROG_ENTRY
+
+// threading
+void init_threads();
+int pass_threads(long long work);
+void apply_gravitational_forces_direct_parallel(Body_store *, int threads);
+void reserve_thread_buffers(Body_store *, int threads);
+
+// reproducible mode
+typedef void (*Gravity_sum_kernel)(Body_store *, int i, int j_start, int j_end, double lanes[3][REPRODUCIBLE_LANES]);
+void apply_gravitational_forces_reproducible(Body_store *);
+void gravity_sum_scalar(Body_store *, int i, int j_start, int j_end, double lanes[3][REPRODUCIBLE_LANES]);
+void gravity_sum_sse2(Body_store *, int i, int j_start, int j_end, double lanes[3][REPRODUCIBLE_LANES]);
+void gravity_sum_avx2(Body_store *, int i, int j_start, int j_end, double lanes[3][REPRODUCIBLE_LANES]);
+void gravity_sum_avx512(Body_store *, int i, int j_start, int j_end, double lanes[3][REPRODUCIBLE_LANES]);
+void gravity_sum_ordered(Body_store *, int i, int sources);
+double sum_lanes(const double lanes[REPRODUCIBLE_LANES]);
+Gravity_sum_kernel gravity_sum = gravity_sum_scalar;
+
+// barnes-hut
+void apply_gravitational_forces_barnes_hut(Body_store *);
+Chunk *build_octree(Body_store *, int count);
+Chunk *build_chunk(Body_store *, Vec3 centre, double half_size, int first, int count, int depth);
+Vec3 chunk_acceleration(Chunk *chunk, Body_store *, int target);
+
+// fast multipole
+void apply_gravitational_forces_fmm(Body_store *);
+void init_fmm(Body_store *, int order, int chunks);
+void fmm_powers(Vec3 d, int order, double powers[3][MAX_FMM_ORDER + 1]);
+void fmm_children(Chunk *chunk, Chunk *children[8]);
+void fmm_upward(Chunk *chunk, Body_store *);
+void fmm_taylor_coefficients(Body_store *, Vec3 r, double *taylor);
+void fmm_translate(Body_store *, Chunk *a, Chunk *b);
+void fmm_leaf_pairs(Chunk *a, Chunk *b, Body_store *);
+void fmm_interact(Chunk *a, Chunk *b, Body_store *);
+void fmm_self(Chunk *chunk, Body_store *);
+void fmm_downward(Chunk *chunk, Body_store *);
+
+// particle mesh
+void apply_gravitational_forces_particle_mesh(Body_store *);
+void mesh_weights(Body_store *, int i, Vec3 origin, double cell, int node[3], double weight[3][2]);
+void init_mesh(Body_store *, int size);
+void fft_mesh(Body_store *, bool inverse, int occupied);
+void fft(double *data, int n, double *twiddle, bool inverse);
 
 // state updates
-void update(Object *object);
-void update_N(Object[]);
+void update(Body_store *, int i, double dt);
+void update_N(Body_store *, double dt);
+void kick(Body_store *, double dt);
+void drift(Body_store *, double dt);
+
+// hermite
+void init_block_steps(Body_store *);
+int block_level(double step, long long time);
+void hermite_forces(Body_store *, int active[], int no_active);
+long long next_block_time(Body_store *);
+void hermite_predict(Body_store *, double time_seconds);
+void hermite_step(Body_store *);
+
+// integrators
+void start_fixed_step(Body_store *);
+void start_euler(Body_store *);
+void advance_fixed_steps(void (*step)(Body_store *, double), Body_store *, double from, double to);
+void euler_step(Body_store *, double dt);
+void leapfrog_step(Body_store *, double dt);
+void yoshida_step(Body_store *, double dt);
+void forest_ruth_step(Body_store *, double dt);
+bool advance_hermite(Body_store *, double from, double to);
+
+// gauss-radau
+void start_radau(Body_store *);
+bool radau_step(Body_store *, double dt, double *next_step);
+bool advance_radau(Body_store *, double from, double to);
+
+// wisdom-holman
+void start_wisdom_holman(Body_store *);
+void interaction_forces(Body_store *);
+void stumpff(double z, double *c2, double *c3);
+void kepler_drift(double mu, double position[3], double velocity[3], double dt);
+void interaction_kick(Body_store *, double dt);
+void central_jump(Body_store *, double dt);
+void kepler_drifts(Body_store *, double dt);
+void wisdom_holman_step(Body_store *, double dt);
+
+// encke
+void init_encke(Body_store *);
+void rectify(Body_store *, int i);
+void centre_of_mass(Body_store *, double centre[6]);
+void recentre_encke(Body_store *, double before[6], double dt);
+void update_encke(Body_store *, int i, double dt);
+
+// respa
+void start_respa(Body_store *);
+double respa_switch(double distance);
+void build_neighbour_lists(Body_store *);
+int chunk_neighbours(Chunk *chunk, Body_store *, int target, double reach, int lowest, int *found);
+bool lists_outdated(Body_store *);
+double moved_squared(Body_store *, int i);
+void near_forces(Body_store *);
+void near_forces_parallel(Body_store *, int threads);
+void near_row(Body_store *, int i, double *ax, double *ay, double *az);
+void near_pull(Body_store *, int i);
+void respa_forces(Body_store *);
+void kick_with(Body_store *, double *ax, double *ay, double *az, double dt);
+void respa_step(Body_store *, double dt, int substeps);
+bool advance_respa(Body_store *, double from, double to);
+
+// in the same order as enum Integrators
+Integrator integrators[] = {
+    {"Euler", start_euler, euler_step, NULL, true},
+    {"Leapfrog", start_fixed_step, leapfrog_step, NULL, true},
+    {"Yoshida-4", start_fixed_step, yoshida_step, NULL, true},
+    {"Forest-Ruth", start_fixed_step, forest_ruth_step, NULL, false},
+    {"Hermite", init_block_steps, NULL, advance_hermite, false},
+    {"Gauss-Radau", start_radau, NULL, advance_radau, false},
+    {"Wisdom-Holman", start_wisdom_holman, wisdom_holman_step, NULL, true},
+    {"RESPA", start_respa, NULL, advance_respa, true},
+};
 
 // simulation log
-void update_log(Object *, Object[], int time);
-Object *get_log_data(Object *sim_log, int time_seconds);
+void init_log(Simulation_log *, int count);
+void start_log(Simulation_log *, Body_store *);
+char *log_chunk(Simulation_log *, int chunk);
+size_t log_stream_size(Simulation_log *);
+void write_log_value(Simulation_log *, size_t row, int stream, int body, Vec3 value);
+size_t log_chunk_part(Simulation_log *, int chunk, int part, char **data);
+Vec3 read_log_value(Simulation_log *, size_t row, int stream, int body);
+void free_log(Simulation_log *);
+void update_log(Simulation_log *, Body_store *, int time);
+size_t log_index(Simulation_log *, int time_seconds);
+void log_state(Simulation_log *, int time_seconds, int body, Vec3 *position, Vec3 *velocity);
+void interpolate_rows(Vec3 *position, Vec3 *velocity, Vec3 next_position, Vec3 next_velocity, int offset);
+Vec3 log_position(Simulation_log *, int time_seconds, int body);
+Vec3 log_velocity(Simulation_log *, int time_seconds, int body);
+Object *get_log_data(Simulation_log *sim_log, int time_seconds);
+
+// chebyshev log
+void append_chebyshev_row(Simulation_log *, Body_store *);
+void fit_segments(Simulation_log *, int first, int last);
+void add_segment(Simulation_log *, Log_segment);
+double fit_chebyshev(Simulation_log *, int first, int rows, int degree, double coefficients[]);
+void chebyshev_terms(double s, int degree, double terms[], double derivatives[]);
+double *log_coefficients(Simulation_log *, size_t count);
+void chebyshev_state(Log_segment *, double row, int body, Vec3 *position, Vec3 *velocity);
+size_t save_chebyshev_log(Simulation_log *, char *buffer);
+void load_chebyshev_log(Simulation_log *, FILE *, const char *path);
 
 // simulation control
-void simulate(Object *sim_log, Object initial_objects[], Object objects[], int time_seconds);
+void simulate(Simulation_log *sim_log, Object initial_objects[], Body_store *bodies, int time_seconds);
+int run_simulation(Simulation_log *sim_log, Object initial_objects[], Body_store *bodies, int time_seconds);
+int continue_simulation(Simulation_log *sim_log, Object initial_objects[], Body_store *bodies, int from, int to);
+void handle_drift(Simulation_log *sim_log, Object initial_objects[], Body_store *bodies, int time_seconds, int drifted);
+bool extend_simulation(Simulation_log *sim_log, Object initial_objects[], Body_store *bodies, int time_seconds);
+Run_settings current_settings();
+void apply_settings(Run_settings *);
+bool same_run(Run_settings *, Run_settings *);
+
+// conservation monitor
+double monitor_sample(Body_store *, int time_seconds);
+void reserve_samples(int count);
+Conservation *monitor_at(int time_seconds);
+bool refine_accuracy();
+_Thread_local Monitor monitor = {0}; // samples of the last simulation run on this thread
+
+// checkpoints
+int checkpoint_sections(Body_store *, Object initial_objects[], Checkpoint_section sections[]);
+void save_checkpoint(Simulation_log *sim_log, Object initial_objects[], Body_store *, int time_seconds);
+DWORD WINAPI write_checkpoint(LPVOID parameter);
+void finish_checkpoint();
+Simulation_log *load_checkpoint(Arena *, const char *path, Object **initial_objects, Body_store *);
+void read_checkpoint(FILE *file, void *data, size_t size, const char *path);
+Checkpoint_writer checkpoint_writer = {0};
+
+// ensemble
+void load_ensemble(Arena *, int scenario, int count, int variants, Ensemble *);
+void update_ensemble_log(Ensemble *, int first, int last, size_t row);
+typedef void (*Ensemble_kernel)(Ensemble *, int first, int last);
+void ensemble_forces_scalar(Ensemble *, int first, int last);
+void ensemble_forces_sse2(Ensemble *, int first, int last);
+void ensemble_forces_avx2(Ensemble *, int first, int last);
+void ensemble_forces_avx512(Ensemble *, int first, int last);
+Ensemble_kernel ensemble_forces = ensemble_forces_scalar;
+void ensemble_leapfrog_step(Ensemble *, int first, int last, double dt);
+void simulate_ensemble(Ensemble *, int time_seconds);
+void run_ensemble(int scenario, int count, int variants);
+
+// parameter sweep
+void run_sweep_entry(Sweep_run *, Object base[], int count, int duration);
+int compare_sweep_runs(const void *a, const void *b);
+void run_sweep(int scenario, int count, int delta_times[], int no_delta_times, int log_steps[], int no_log_steps, int variants);
+int parse_list(const char *text, int values[], int max);
+#define MAX_SWEEP_VALUES 32
 
 // rendering
-void render_objects_static(Object *sim_log, int time_seconds);
-void calculate_motion_trails(Object *sim_log, int time_seconds, Motion_trail trails[][200], double *closest_depth);
-char render_interactive(Object *sim_log, int time_seconds, bool have_time_control);
-void render_objects_playback(Object *sim_log, int start, int end);
-void rotate_render(Object *sim_log, int time_seconds);
+void render_objects_static(Simulation_log *sim_log, int time_seconds);
+void calculate_motion_trails(Simulation_log *sim_log, int time_seconds, Motion_trail trails[][200], double *closest_depth);
+char render_interactive(Simulation_log *sim_log, int time_seconds, bool have_time_control);
+void render_objects_playback(Simulation_log *sim_log, int start, int end);
+void rotate_render(Simulation_log *sim_log, int time_seconds);
 Vec3 rotate_z_up(Vec3 v, double spin_deg, double pitch_deg);
 void pan_camera(Vec3, double move, double pitch, double yaw);
 
@@ -183,6 +919,8 @@ Mat3 create_yaw_matrix(double yaw);
 
 // utility
 bool is_interval(int, int);
+int compare_ints(const void *a, const void *b);
+double wall_seconds();
 char *display_time(int);
 char *format_number(double number);
 double calculate_resolution();
@@ -194,29 +932,295 @@ void clear_screen() {printf("\033[2J\033[H"); };
 
 
 // ui
-int program_ui(Object *sim_log, Object[], Object[]);
-int simulation_ui(Object *sim_log, Object[], Object[]);
+int program_ui(Simulation_log *sim_log, Object[], Body_store *);
+int simulation_ui(Simulation_log *sim_log, Object[], Body_store *);
 int settings_ui();
 int simulation_settings_ui();
 int render_settings_ui();
 void intro();
 void menu_banner(int menu);
 
-int main()
+int main(int argc, char *argv[])
 {
-    Object objects[NO_OBJECTS];
-    Object initial_objects[NO_OBJECTS];
+    Arena arena = {0};
+    Object *initial_objects;
+    Body_store bodies = {0};
+    Simulation_log *simulation_log;
+
+    int scenario = EARTH_MOON_SATELLITE;
+    int count = 3;
+
+    // law_of_gravitationV2 reproducible [any of the below], for runs that have to match bit for bit
+    if (argc >= 2 && strcmp(argv[1], "reproducible") == 0)
+    {
+        reproducible = true;
+        argc--;
+        argv++;
+    }
+
+    // law_of_gravitationV2 checkpoint <simulated hours between checkpoints> [any of the below]
+    if (argc >= 3 && strcmp(argv[1], "checkpoint") == 0)
+    {
+        checkpoint_step = (atoi(argv[2]) > 0) ? atoi(argv[2]) * HOUR : 0;
+        argc -= 2;
+        argv += 2;
+    }
+
+    // law_of_gravitationV2 resume <checkpoint file>
+    // carries on the run saved in the checkpoint with the settings it had
+    const char *resume_path = NULL;
+    if (argc >= 3 && strcmp(argv[1], "resume") == 0)
+    {
+        resume_path = argv[2];
+    }
+
+    // law_of_gravitationV2 ensemble <variants> [log step in minutes, 60 if not given]
+    // runs that many variants of the Earth, Moon and satellite side by side and reports on them
+    if (argc >= 3 && strcmp(argv[1], "ensemble") == 0)
+    {
+        int variants = atoi(argv[2]);
+        if (variants < 1)
+        {
+            variants = 1;
+        }
+
+        // hourly unless asked, a minute's rows for thousands of variants run to gigabytes even as floats
+        log_step = (argc >= 4 && atoi(argv[3]) > 0) ? atoi(argv[3]) * MINUTE : HOUR;
 
-    int rows = time_scale / log_step;
-    int cols = NO_OBJECTS;
+        init_simd();
+        init_threads();
+        run_ensemble(EARTH_MOON_SATELLITE, count, variants);
 
-    Object *simulation_log = malloc(rows * cols * sizeof(Object));
-    if (!simulation_log)
+        return 0;
+    }
+
+    // law_of_gravitationV2 sweep <delta times in seconds> <log steps in minutes> [variants], e.g. sweep 10,30,60 60,1440 4
+    // runs every combination on every core and prints one table of the results
+    if (argc >= 4 && strcmp(argv[1], "sweep") == 0)
+    {
+        int delta_times[MAX_SWEEP_VALUES], log_steps[MAX_SWEEP_VALUES];
+        int no_delta_times = parse_list(argv[2], delta_times, MAX_SWEEP_VALUES);
+        int no_log_steps = parse_list(argv[3], log_steps, MAX_SWEEP_VALUES);
+        int variants = (argc >= 5 && atoi(argv[4]) > 0) ? atoi(argv[4]) : 1;
+
+        for (int i = 0; i < no_log_steps; i++)
+        {
+            log_steps[i] *= MINUTE;
+        }
+
+        if (no_delta_times == 0 || no_log_steps == 0)
+        {
+            printf("usage: law_of_gravitationV2 sweep <delta times in seconds> <log steps in minutes> [variants]\n");
+            return 1;
+        }
+
+        init_simd();
+        init_threads();
+        run_sweep(EARTH_MOON_SATELLITE, count, delta_times, no_delta_times, log_steps, no_log_steps, variants);
+
+        return 0;
+    }
+
+    // law_of_gravitationV2 cluster|constellation <bodies> [log step in minutes]
+    if (argc >= 3 && (strcmp(argv[1], "cluster") == 0 || strcmp(argv[1], "constellation") == 0))
+    {
+        scenario = (strcmp(argv[1], "cluster") == 0) ? CLUSTER : CONSTELLATION;
+        count = atoi(argv[2]);
+        if (count < 3)
+        {
+            count = 3;
+        }
+
+        if (argc >= 4 && atoi(argv[3]) > 0)
+        {
+            log_step = atoi(argv[3]) * MINUTE;
+        }
+    }
+
+    // set initial values
+    init_camera();
+    init_simd();
+    init_threads();
+
+    if (resume_path)
+    {
+        simulation_log = load_checkpoint(&arena, resume_path, &initial_objects, &bodies);
+        extend_simulation(simulation_log, initial_objects, &bodies, time_scale);
+    }
+    else
+    {
+        simulation_log = load_scenario(&arena, scenario, count, &initial_objects, &bodies);
+        simulate(simulation_log, initial_objects, &bodies, time_scale);
+    }
+
+    clear_screen();
+    render_interactive(simulation_log, 0, false);
+    program_ui(simulation_log, initial_objects, &bodies);
+    
+    /*
+    // i timestep = delta_time
+    for (int i = 0; i < (time_scale / delta_time) + 1; i++)
+    {
+
+        // log every log_step
+        update_log(simulation_log, objects, i * delta_time);
+
+        // render every day
+        if (is_interval(DAY_INTERVAL, i))
+        {
+            display_time(i * delta_time);
+            render_objects(objects, XY, 1);
+            display_position(objects[0]);
+
+        }
+
+
+        apply_gravitational_forces_N(objects);
+        update_N(objects);
+    }
+
+    */
+
+    // render_objects(get_log_data(simulation_log, objects, WEEK - (DAY / 2)), XY, 1);
+    finish_checkpoint();
+    free_log(simulation_log);
+    free(monitor.samples);
+    free(arena.base);
+
+    return 0;
+}
+
+/*
+    arena
+*/
+// allocates one block that everything sized by the scenario is carved out of
+void init_arena(Arena *arena, size_t size)
+{
+    free(arena->base);
+
+    arena->base = malloc(size);
+    if (!arena->base)
     {
         perror("malloc failed");
         exit(EXIT_FAILURE);
     }
 
+    arena->size = size;
+    arena->used = 0;
+}
+
+// hands out the next cache line aligned piece of the arena
+void *arena_alloc(Arena *arena, size_t size)
+{
+    uintptr_t start = ((uintptr_t)arena->base + arena->used + (ARENA_ALIGNMENT - 1)) & ~(uintptr_t)(ARENA_ALIGNMENT - 1);
+    size_t offset = start - (uintptr_t)arena->base;
+
+    if (offset + size > arena->size)
+    {
+        fprintf(stderr, "arena out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+
+    arena->used = offset + size;
+    return arena->base + offset;
+}
+
+/*
+    scenarios
+*/
+// sizes the arena for a scenario, carves the bodies and simulation log out of it and fills in the objects
+Simulation_log *load_scenario(Arena *arena, int scenario, int count, Object **initial_objects, Body_store *bodies)
+{
+    Simulation_log *sim_log = init_scenario(arena, count, initial_objects, bodies);
+
+    create_scenario(*initial_objects, scenario, count);
+
+    return sim_log;
+}
+
+// sizes the arena for count bodies and carves the initial objects, the body store and the simulation log out of it,
+// the log's rows are allocated as they are written
+Simulation_log *init_scenario(Arena *arena, int count, Object **initial_objects, Body_store *bodies)
+{
+    size_t size = 0;
+
+    no_objects = count;
+
+    // every allocation below, with room to align each one. The log and the conservation samples
+    // grow with the run, so they are allocated as it goes
+    size += count * sizeof(Object);
+    size += BODY_STORE_ARRAYS * count * sizeof(double) + count * sizeof(char);
+    size += sizeof(Simulation_log);
+    size += 3 * count * sizeof(double);
+    size += (BODY_STORE_ARRAYS + 6) * ARENA_ALIGNMENT;
+
+    init_arena(arena, size);
+
+    *initial_objects = arena_alloc(arena, count * sizeof(Object));
+    init_bodies(bodies, count, arena);
+    Simulation_log *sim_log = arena_alloc(arena, sizeof(Simulation_log));
+    init_log(sim_log, count);
+
+    free(monitor.samples);
+    monitor = (Monitor){0};
+    monitor.saved_x = arena_alloc(arena, count * sizeof(double));
+    monitor.saved_y = arena_alloc(arena, count * sizeof(double));
+    monitor.saved_z = arena_alloc(arena, count * sizeof(double));
+
+    return sim_log;
+}
+
+// changes every position and velocity component by up to ensemble_spread of itself, variant 0 is left
+// as it is. The same variant always gets the same changes, whichever thread makes them
+void perturb_objects(Object objects[], int count, int variant)
+{
+    if (variant == 0)
+        return;
+
+    uint64_t state = (uint64_t)variant * 0x9E3779B97F4A7C15ULL;
+
+    for (int i = 0; i < count; i++)
+    {
+        double *components[6] = {
+            &objects[i].motion.position.x, &objects[i].motion.position.y, &objects[i].motion.position.z,
+            &objects[i].motion.velocity.x, &objects[i].motion.velocity.y, &objects[i].motion.velocity.z};
+
+        for (int k = 0; k < 6; k++)
+        {
+            *components[k] *= 1.0 + ensemble_spread * random_signed(&state);
+        }
+    }
+}
+
+// uniform in [-1, 1) from a 64 bit linear congruential generator, the caller keeps the state so threads never share one
+double random_signed(uint64_t *state)
+{
+    *state = *state * 6364136223846793005ULL + 1442695040888963407ULL;
+    return (double)(*state >> 11) / 4503599627370496.0 - 1.0;
+}
+
+// fills in the objects of a scenario, test particles last
+void create_scenario(Object objects[], int scenario, int count)
+{
+    if (scenario == CLUSTER)
+    {
+        create_cluster(objects, count);
+    }
+    else if (scenario == CONSTELLATION)
+    {
+        create_constellation(objects, count);
+    }
+    else
+    {
+        create_earth_moon_satellite(objects);
+    }
+
+    sort_test_particles(objects, count);
+}
+
+// the Earth, the Moon and a satellite
+void create_earth_moon_satellite(Object objects[])
+{
     // Earth - orbiting speed 30,000
     objects[0].mass = 5.972e24; // kg
     objects[0].motion.position = (Vec3){0.0f, 0.0f, 0.0};
@@ -247,181 +1251,5839 @@ int main()
     objects[3].motion.force = (Vec3){0.0f, 0.0f, 0.0f};        // m/s (orbital speed)
     objects[3].symbol = 'o';
     */
+}
 
-    memcpy(initial_objects, objects, sizeof(objects));
-    
-    // set initial values
-    init_camera();
-    simulate(simulation_log, initial_objects, objects, time_scale);
-    clear_screen();
-    render_interactive(simulation_log, 0, false);
-    program_ui(simulation_log, initial_objects, objects);
-    
-    /*
-    // i timestep = delta_time
-    for (int i = 0; i < (time_scale / delta_time) + 1; i++)
-    {
+// the Earth surrounded by a thin disc of small moons on roughly circular orbits
+void create_cluster(Object objects[], int count)
+{
+    srand(1);
+
+    objects[0].mass = 5.972e24; // kg
+    objects[0].motion.position = (Vec3){0.0f, 0.0f, 0.0f};
+    objects[0].motion.velocity = (Vec3){0.0f, 0.0f, 0.0f};
+    objects[0].motion.force = (Vec3){0.0f, 0.0f, 0.0f};
+    objects[0].symbol = 'E';
+
+    for (int i = 1; i < count; i++)
+    {
+        double radius = 2e7 + 3.8e8 * ((double)rand() / RAND_MAX);          // metres from Earth
+        double angle = 2 * M_PI * ((double)rand() / RAND_MAX);
+        double height = radius * 0.02 * (((double)rand() / RAND_MAX) - 0.5);
+        double speed = sqrt(GRAVITATIONAL_CONSTANT * objects[0].mass / radius); // circular orbital speed
+
+        objects[i].mass = 1e15 * (1 + rand() % 1000); // kg
+        objects[i].motion.position = (Vec3){radius * cos(angle), radius * sin(angle), height};
+        objects[i].motion.velocity = (Vec3){-speed * sin(angle), speed * cos(angle), 0.0f};
+        objects[i].motion.force = (Vec3){0.0f, 0.0f, 0.0f};
+        objects[i].symbol = '.';
+    }
+}
+
+// the Earth and the Moon with a swarm of satellites in orbits between 7000 and 42000 km
+void create_constellation(Object objects[], int count)
+{
+    srand(1);
+
+    objects[0].mass = 5.972e24; // kg
+    objects[0].motion.position = (Vec3){0.0f, 0.0f, 0.0f};
+    objects[0].motion.velocity = (Vec3){0.0f, 0.0f, 0.0f};
+    objects[0].motion.force = (Vec3){0.0f, 0.0f, 0.0f};
+    objects[0].symbol = 'E';
+
+    objects[1].mass = 7.348e22; // kg
+    objects[1].motion.position = (Vec3){384400000.0f, 0.0f, 0.0f};
+    objects[1].motion.velocity = (Vec3){0.0f, 1022.0f, 0.0f};
+    objects[1].motion.force = (Vec3){0.0f, 0.0f, 0.0f};
+    objects[1].symbol = 'M';
+
+    for (int i = 2; i < count; i++)
+    {
+        double radius = 7e6 + 3.5e7 * ((double)rand() / RAND_MAX);          // metres from Earth
+        double angle = 2 * M_PI * ((double)rand() / RAND_MAX);
+        double inclination = M_PI * ((double)rand() / RAND_MAX);
+        double speed = sqrt(GRAVITATIONAL_CONSTANT * objects[0].mass / radius); // circular orbital speed
+
+        // circular orbit in a plane tilted about the x axis
+        objects[i].mass = 500 + rand() % 5000; // kg
+        objects[i].motion.position = (Vec3){radius * cos(angle), radius * sin(angle) * cos(inclination), radius * sin(angle) * sin(inclination)};
+        objects[i].motion.velocity = (Vec3){-speed * sin(angle), speed * cos(angle) * cos(inclination), speed * cos(angle) * sin(inclination)};
+        objects[i].motion.force = (Vec3){0.0f, 0.0f, 0.0f};
+        objects[i].symbol = 's';
+    }
+}
+
+// stable partition putting the test particles behind the massive bodies, see test_particle_ratio
+void sort_test_particles(Object objects[], int count)
+{
+    double heaviest = 0.0;
+    int massive = 0;
+
+    for (int i = 0; i < count; i++)
+    {
+        heaviest = fmax(heaviest, objects[i].mass);
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        if (objects[i].mass >= test_particle_ratio * heaviest)
+        {
+            // shift the test particles passed so far up by one to keep their order
+            Object object = objects[i];
+            memmove(&objects[massive + 1], &objects[massive], (i - massive) * sizeof(Object));
+            objects[massive++] = object;
+        }
+    }
+}
+
+/*
+    body store
+*/
+// carves the arrays of a body store for a given number of bodies out of the arena
+void init_bodies(Body_store *bodies, int count, Arena *arena)
+{
+    double **arrays[BODY_STORE_ARRAYS] = {
+        &bodies->position_x, &bodies->position_y, &bodies->position_z,
+        &bodies->velocity_x, &bodies->velocity_y, &bodies->velocity_z,
+        &bodies->acceleration_x, &bodies->acceleration_y, &bodies->acceleration_z,
+        &bodies->mass, &bodies->gm};
+
+    bodies->count = count;
+
+    for (int i = 0; i < BODY_STORE_ARRAYS; i++)
+    {
+        *arrays[i] = arena_alloc(arena, count * sizeof(double));
+        memset(*arrays[i], 0, count * sizeof(double));
+    }
+
+    bodies->symbol = arena_alloc(arena, count * sizeof(char));
+
+    // not advanced with anything yet
+    bodies->time = 0;
+    memset(&bodies->settings, 0, sizeof(Run_settings));
+
+    free(bodies->thread_acceleration);
+    bodies->thread_acceleration = NULL;
+    bodies->thread_buffers = 0;
+}
+
+// frees everything the integrators and force solvers allocated for a body store, the arrays
+// themselves belong to the arena
+void free_bodies(Body_store *bodies)
+{
+    Block_steps *blocks = &bodies->blocks;
+    void *allocations[] = {
+        bodies->thread_acceleration,
+        blocks->position_x, blocks->position_y, blocks->position_z,
+        blocks->velocity_x, blocks->velocity_y, blocks->velocity_z,
+        blocks->jerk_x, blocks->jerk_y, blocks->jerk_z,
+        blocks->new_acceleration_x, blocks->new_acceleration_y, blocks->new_acceleration_z,
+        blocks->new_jerk_x, blocks->new_jerk_y, blocks->new_jerk_z,
+        blocks->time, blocks->level, blocks->active,
+        bodies->radau.block,
+        bodies->wisdom_holman.kick_x, bodies->wisdom_holman.kick_y, bodies->wisdom_holman.kick_z,
+        bodies->encke.mode, bodies->encke.reference, bodies->encke.deviation, bodies->encke.elapsed,
+        bodies->respa.near_x, bodies->respa.near_y, bodies->respa.near_z,
+        bodies->respa.far_x, bodies->respa.far_y, bodies->respa.far_z,
+        bodies->respa.listed_x, bodies->respa.listed_y, bodies->respa.listed_z, bodies->respa.first, bodies->respa.neighbours,
+        bodies->octree.pool, bodies->octree.order, bodies->octree.slot, bodies->octree.octant, bodies->octree.sorted,
+        bodies->mesh.grid, bodies->mesh.green, bodies->mesh.field, bodies->mesh.twiddle,
+        bodies->fmm.power, bodies->fmm.index, bodies->fmm.sum, bodies->fmm.m2l,
+        bodies->fmm.multipole, bodies->fmm.local, bodies->fmm.radius};
+
+    for (int i = 0; i < (int)(sizeof(allocations) / sizeof(allocations[0])); i++)
+    {
+        free(allocations[i]);
+    }
+
+    *bodies = (Body_store){0};
+}
+
+// copies objects into the body store
+void load_bodies(Body_store *bodies, Object objects[])
+{
+    for (int i = 0; i < bodies->count; i++)
+    {
+        bodies->position_x[i] = objects[i].motion.position.x;
+        bodies->position_y[i] = objects[i].motion.position.y;
+        bodies->position_z[i] = objects[i].motion.position.z;
+
+        bodies->velocity_x[i] = objects[i].motion.velocity.x;
+        bodies->velocity_y[i] = objects[i].motion.velocity.y;
+        bodies->velocity_z[i] = objects[i].motion.velocity.z;
+
+        bodies->acceleration_x[i] = 0.0;
+        bodies->acceleration_y[i] = 0.0;
+        bodies->acceleration_z[i] = 0.0;
+
+        bodies->mass[i] = objects[i].mass;
+        bodies->gm[i] = GRAVITATIONAL_CONSTANT * objects[i].mass;
+        bodies->symbol[i] = objects[i].symbol;
+    }
+
+    // everything up to the last massive body counts as massive, so an unsorted list is still exact
+    double heaviest = 0.0;
+    for (int i = 0; i < bodies->count; i++)
+    {
+        heaviest = fmax(heaviest, bodies->mass[i]);
+    }
+
+    bodies->massive_count = 0;
+    for (int i = 0; i < bodies->count; i++)
+    {
+        if (bodies->mass[i] >= test_particle_ratio * heaviest)
+        {
+            bodies->massive_count = i + 1;
+        }
+    }
+
+    for (int i = bodies->massive_count; i < bodies->count; i++)
+    {
+        bodies->gm[i] = 0.0;
+    }
+}
+
+// copies one body out of the body store as an object
+Object get_body(Body_store *bodies, int i)
+{
+    Object object;
+
+    object.mass = bodies->mass[i];
+    object.symbol = bodies->symbol[i];
+    object.motion.position = (Vec3){bodies->position_x[i], bodies->position_y[i], bodies->position_z[i]};
+    object.motion.velocity = (Vec3){bodies->velocity_x[i], bodies->velocity_y[i], bodies->velocity_z[i]};
+    object.motion.force = (Vec3){
+        bodies->acceleration_x[i] * bodies->mass[i],
+        bodies->acceleration_y[i] * bodies->mass[i],
+        bodies->acceleration_z[i] * bodies->mass[i]};
+
+    return object;
+}
+
+/*
+    core physics
+*/
+// calculates the distance between two objects
+double distance(Object object1, Object object2)
+{
+    double distanceX = object1.motion.position.x - object2.motion.position.x;
+    double distanceY = object1.motion.position.y - object2.motion.position.y;
+    double distanceZ = object1.motion.position.z - object2.motion.position.z;
+
+    return sqrt(distanceX * distanceX + distanceY * distanceY + distanceZ * distanceZ);
+};
+
+// kinetic plus potential energy of a set of objects, O(N^2)
+double total_energy(Object objects[], int count)
+{
+    double energy = 0.0;
+
+    for (int i = 0; i < count; i++)
+    {
+        Vec3 v = objects[i].motion.velocity;
+        energy += 0.5 * objects[i].mass * (v.x * v.x + v.y * v.y + v.z * v.z);
+
+        for (int j = i + 1; j < count; j++)
+        {
+            energy -= GRAVITATIONAL_CONSTANT * objects[i].mass * objects[j].mass / distance(objects[i], objects[j]);
+        }
+    }
+
+    return energy;
+}
+
+// gravitational force on one object from all the others, for objects read back from the log which
+// only keeps positions and velocities
+Vec3 object_force(Object objects[], int count, int i)
+{
+    Vec3 force = {0.0, 0.0, 0.0};
+
+    for (int j = 0; j < count; j++)
+    {
+        if (j == i)
+            continue;
+
+        double r = distance(objects[i], objects[j]);
+        double scale = GRAVITATIONAL_CONSTANT * objects[i].mass * objects[j].mass / (r * r * r);
+
+        force.x += scale * (objects[j].motion.position.x - objects[i].motion.position.x);
+        force.y += scale * (objects[j].motion.position.y - objects[i].motion.position.y);
+        force.z += scale * (objects[j].motion.position.z - objects[i].motion.position.z);
+    }
+
+    return force;
+}
+
+// applies the gravitational accelerations between two bodies, accumulating into the given arrays
+void apply_gravitational_forces(Body_store *bodies, int i, int j, double *ax, double *ay, double *az)
+{
+    Vec3 r;
+    r.x = bodies->position_x[j] - bodies->position_x[i];
+    r.y = bodies->position_y[j] - bodies->position_y[i];
+    r.z = bodies->position_z[j] - bodies->position_z[i];
+
+    double distance_squared = r.x * r.x + r.y * r.y + r.z * r.z;
+    double inverse_cube = 1.0 / (distance_squared * sqrt(distance_squared));
+
+    // G * m / r^2 along the unit vector r / |r|, the masses cancel out of a = F / m
+    double scale_i = bodies->gm[j] * inverse_cube;
+    double scale_j = bodies->gm[i] * inverse_cube;
+
+    ax[i] += scale_i * r.x;
+    ay[i] += scale_i * r.y;
+    az[i] += scale_i * r.z;
+
+    ax[j] -= scale_j * r.x;
+    ay[j] -= scale_j * r.y;
+    az[j] -= scale_j * r.z;
+}
+
+// applies the gravitational forces between all bodies using the selected force solver
+void apply_gravitational_forces_N(Body_store *bodies)
+{
+    force_passes++;
+
+    switch (force_engine)
+    {
+    case BARNES_HUT:
+        apply_gravitational_forces_barnes_hut(bodies);
+        break;
+
+    case PARTICLE_MESH:
+        apply_gravitational_forces_particle_mesh(bodies);
+        break;
+
+    case FMM:
+        apply_gravitational_forces_fmm(bodies);
+        break;
+
+    case DIRECT:
+    default:
+        apply_gravitational_forces_direct(bodies);
+        break;
+    }
+}
+
+// applies the gravitational forces between every pair of bodies, exact but O(N^2)
+void apply_gravitational_forces_direct(Body_store *bodies)
+{
+    int n = bodies->count;
+
+    if (small_kernel_fits(bodies))
+    {
+        small_force_kernels[n](bodies);
+        return;
+    }
+
+    if (reproducible)
+    {
+        apply_gravitational_forces_reproducible(bodies);
+        return;
+    }
+
+    if (pass_threads(n) > 1)
+    {
+        apply_gravitational_forces_direct_parallel(bodies, thread_count);
+        return;
+    }
+
+    memset(bodies->acceleration_x, 0, n * sizeof(double));
+    memset(bodies->acceleration_y, 0, n * sizeof(double));
+    memset(bodies->acceleration_z, 0, n * sizeof(double));
+
+    // only massive bodies get a row, so pairs of test particles are never visited
+    int rows = (bodies->massive_count < n - 1) ? bodies->massive_count : n - 1;
+
+    for (int i = 0; i < rows; i++)
+    {
+        gravity_row(bodies, i, i + 1, n, bodies->acceleration_x, bodies->acceleration_y, bodies->acceleration_z);
+    }
+}
+
+/*
+    threading
+*/
+// uses every core unless the user picks a thread count in the settings
+void init_threads()
+{
+#ifdef _OPENMP
+    thread_count = omp_get_num_procs();
+#else
+    thread_count = 1;
+#endif
+}
+
+// threads for a pass over work bodies, every one the user allows once there are enough to pay for them
+int pass_threads(long long work)
+{
+    return (work >= PARALLEL_MIN_BODIES) ? thread_count : 1;
+}
+
+// makes room for every thread's own x, y and z accelerations of every body
+void reserve_thread_buffers(Body_store *bodies, int threads)
+{
+    if (bodies->thread_buffers < threads)
+    {
+        free(bodies->thread_acceleration);
+        bodies->thread_acceleration = malloc((size_t)threads * 3 * bodies->count * sizeof(double));
+        if (!bodies->thread_acceleration)
+        {
+            perror("malloc failed");
+            exit(EXIT_FAILURE);
+        }
+        bodies->thread_buffers = threads;
+    }
+}
+
+// direct pass split across threads, each thread keeps Newton's third law by writing both bodies of
+// a pair into its own acceleration arrays, which are then summed body by body
+void apply_gravitational_forces_direct_parallel(Body_store *bodies, int threads)
+{
+    int n = bodies->count;
+    int rows = (bodies->massive_count < n - 1) ? bodies->massive_count : n - 1;
+
+    reserve_thread_buffers(bodies, threads);
+
+    OMP_PRAGMA(omp parallel num_threads(threads))
+    {
+        int thread = 0;
+        int team_size = 1;
+#ifdef _OPENMP
+        thread = omp_get_thread_num();
+        team_size = omp_get_num_threads();
+#endif
+        double *ax = &bodies->thread_acceleration[(size_t)thread * 3 * n];
+        double *ay = ax + n;
+        double *az = ay + n;
+
+        memset(ax, 0, 3 * n * sizeof(double));
+
+        OMP_PRAGMA(omp barrier)
+
+        // rows get shorter as i grows, so they are handed out a few at a time
+        OMP_PRAGMA(omp for schedule(dynamic, 16))
+        for (int i = 0; i < rows; i++)
+        {
+            gravity_row(bodies, i, i + 1, n, ax, ay, az);
+        }
+
+        // parallel reduction, every thread sums all the buffers for its own range of bodies
+        OMP_PRAGMA(omp for schedule(static))
+        for (int j = 0; j < n; j++)
+        {
+            double sum_x = 0.0, sum_y = 0.0, sum_z = 0.0;
+
+            for (int t = 0; t < team_size; t++)
+            {
+                double *buffer = &bodies->thread_acceleration[(size_t)t * 3 * n];
+                sum_x += buffer[j];
+                sum_y += buffer[n + j];
+                sum_z += buffer[2 * n + j];
+            }
+
+            bodies->acceleration_x[j] = sum_x;
+            bodies->acceleration_y[j] = sum_y;
+            bodies->acceleration_z[j] = sum_z;
+        }
+    }
+}
+
+/*
+    vector kernels
+
+    Each kernel applies the pair forces between body i and bodies j_start .. j_end - 1, adding
+    to i and subtracting from each j. Every pair does the same IEEE operations as the scalar
+    kernel (sqrt and divide are correctly rounded), only the order the lanes of body i are summed
+    in and fused multiply-adds differ. The vector results match gravity_row_scalar to within
+    1e-13 of the sum of the magnitudes of the pair accelerations.
+*/
+// one pair at a time, used when the cpu has no vector support and for the tails of the vector kernels
+void gravity_row_scalar(Body_store *bodies, int i, int j_start, int j_end, double *ax, double *ay, double *az)
+{
+    for (int j = j_start; j < j_end; j++)
+    {
+        apply_gravitational_forces(bodies, i, j, ax, ay, az);
+    }
+}
+
+#ifdef SIMD_KERNELS
+
+// 2 bodies per instruction
+__attribute__((target("sse2")))
+void gravity_row_sse2(Body_store *bodies, int i, int j_start, int j_end, double *ax, double *ay, double *az)
+{
+    __m128d xi = _mm_set1_pd(bodies->position_x[i]);
+    __m128d yi = _mm_set1_pd(bodies->position_y[i]);
+    __m128d zi = _mm_set1_pd(bodies->position_z[i]);
+    __m128d gmi = _mm_set1_pd(bodies->gm[i]);
+    __m128d one = _mm_set1_pd(1.0);
+
+    __m128d sum_x = _mm_setzero_pd();
+    __m128d sum_y = _mm_setzero_pd();
+    __m128d sum_z = _mm_setzero_pd();
+
+    int j = j_start;
+    for (; j + 2 <= j_end; j += 2)
+    {
+        __m128d dx = _mm_sub_pd(_mm_loadu_pd(&bodies->position_x[j]), xi);
+        __m128d dy = _mm_sub_pd(_mm_loadu_pd(&bodies->position_y[j]), yi);
+        __m128d dz = _mm_sub_pd(_mm_loadu_pd(&bodies->position_z[j]), zi);
+
+        __m128d distance_squared = _mm_add_pd(_mm_add_pd(_mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy)), _mm_mul_pd(dz, dz));
+        __m128d inverse_cube = _mm_div_pd(one, _mm_mul_pd(distance_squared, _mm_sqrt_pd(distance_squared)));
+
+        __m128d scale_i = _mm_mul_pd(_mm_loadu_pd(&bodies->gm[j]), inverse_cube);
+        __m128d scale_j = _mm_mul_pd(gmi, inverse_cube);
+
+        sum_x = _mm_add_pd(sum_x, _mm_mul_pd(scale_i, dx));
+        sum_y = _mm_add_pd(sum_y, _mm_mul_pd(scale_i, dy));
+        sum_z = _mm_add_pd(sum_z, _mm_mul_pd(scale_i, dz));
+
+        _mm_storeu_pd(&ax[j], _mm_sub_pd(_mm_loadu_pd(&ax[j]), _mm_mul_pd(scale_j, dx)));
+        _mm_storeu_pd(&ay[j], _mm_sub_pd(_mm_loadu_pd(&ay[j]), _mm_mul_pd(scale_j, dy)));
+        _mm_storeu_pd(&az[j], _mm_sub_pd(_mm_loadu_pd(&az[j]), _mm_mul_pd(scale_j, dz)));
+    }
+
+    double lanes[2];
+    _mm_storeu_pd(lanes, sum_x); ax[i] += lanes[0] + lanes[1];
+    _mm_storeu_pd(lanes, sum_y); ay[i] += lanes[0] + lanes[1];
+    _mm_storeu_pd(lanes, sum_z); az[i] += lanes[0] + lanes[1];
+
+    gravity_row_scalar(bodies, i, j, j_end, ax, ay, az);
+}
+
+// 4 bodies per instruction
+__attribute__((target("avx2,fma")))
+void gravity_row_avx2(Body_store *bodies, int i, int j_start, int j_end, double *ax, double *ay, double *az)
+{
+    __m256d xi = _mm256_set1_pd(bodies->position_x[i]);
+    __m256d yi = _mm256_set1_pd(bodies->position_y[i]);
+    __m256d zi = _mm256_set1_pd(bodies->position_z[i]);
+    __m256d gmi = _mm256_set1_pd(bodies->gm[i]);
+    __m256d one = _mm256_set1_pd(1.0);
+
+    __m256d sum_x = _mm256_setzero_pd();
+    __m256d sum_y = _mm256_setzero_pd();
+    __m256d sum_z = _mm256_setzero_pd();
+
+    int j = j_start;
+    for (; j + 4 <= j_end; j += 4)
+    {
+        __m256d dx = _mm256_sub_pd(_mm256_loadu_pd(&bodies->position_x[j]), xi);
+        __m256d dy = _mm256_sub_pd(_mm256_loadu_pd(&bodies->position_y[j]), yi);
+        __m256d dz = _mm256_sub_pd(_mm256_loadu_pd(&bodies->position_z[j]), zi);
+
+        __m256d distance_squared = _mm256_fmadd_pd(dz, dz, _mm256_fmadd_pd(dy, dy, _mm256_mul_pd(dx, dx)));
+        __m256d inverse_cube = _mm256_div_pd(one, _mm256_mul_pd(distance_squared, _mm256_sqrt_pd(distance_squared)));
+
+        __m256d scale_i = _mm256_mul_pd(_mm256_loadu_pd(&bodies->gm[j]), inverse_cube);
+        __m256d scale_j = _mm256_mul_pd(gmi, inverse_cube);
+
+        sum_x = _mm256_fmadd_pd(scale_i, dx, sum_x);
+        sum_y = _mm256_fmadd_pd(scale_i, dy, sum_y);
+        sum_z = _mm256_fmadd_pd(scale_i, dz, sum_z);
+
+        _mm256_storeu_pd(&ax[j], _mm256_fnmadd_pd(scale_j, dx, _mm256_loadu_pd(&ax[j])));
+        _mm256_storeu_pd(&ay[j], _mm256_fnmadd_pd(scale_j, dy, _mm256_loadu_pd(&ay[j])));
+        _mm256_storeu_pd(&az[j], _mm256_fnmadd_pd(scale_j, dz, _mm256_loadu_pd(&az[j])));
+    }
+
+    double lanes[4];
+    _mm256_storeu_pd(lanes, sum_x); ax[i] += (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+    _mm256_storeu_pd(lanes, sum_y); ay[i] += (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+    _mm256_storeu_pd(lanes, sum_z); az[i] += (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+
+    gravity_row_scalar(bodies, i, j, j_end, ax, ay, az);
+}
+
+// 8 bodies per instruction
+__attribute__((target("avx512f")))
+void gravity_row_avx512(Body_store *bodies, int i, int j_start, int j_end, double *ax, double *ay, double *az)
+{
+    __m512d xi = _mm512_set1_pd(bodies->position_x[i]);
+    __m512d yi = _mm512_set1_pd(bodies->position_y[i]);
+    __m512d zi = _mm512_set1_pd(bodies->position_z[i]);
+    __m512d gmi = _mm512_set1_pd(bodies->gm[i]);
+    __m512d one = _mm512_set1_pd(1.0);
+
+    __m512d sum_x = _mm512_setzero_pd();
+    __m512d sum_y = _mm512_setzero_pd();
+    __m512d sum_z = _mm512_setzero_pd();
+
+    int j = j_start;
+    for (; j + 8 <= j_end; j += 8)
+    {
+        __m512d dx = _mm512_sub_pd(_mm512_loadu_pd(&bodies->position_x[j]), xi);
+        __m512d dy = _mm512_sub_pd(_mm512_loadu_pd(&bodies->position_y[j]), yi);
+        __m512d dz = _mm512_sub_pd(_mm512_loadu_pd(&bodies->position_z[j]), zi);
+
+        __m512d distance_squared = _mm512_fmadd_pd(dz, dz, _mm512_fmadd_pd(dy, dy, _mm512_mul_pd(dx, dx)));
+        __m512d inverse_cube = _mm512_div_pd(one, _mm512_mul_pd(distance_squared, _mm512_sqrt_pd(distance_squared)));
+
+        __m512d scale_i = _mm512_mul_pd(_mm512_loadu_pd(&bodies->gm[j]), inverse_cube);
+        __m512d scale_j = _mm512_mul_pd(gmi, inverse_cube);
+
+        sum_x = _mm512_fmadd_pd(scale_i, dx, sum_x);
+        sum_y = _mm512_fmadd_pd(scale_i, dy, sum_y);
+        sum_z = _mm512_fmadd_pd(scale_i, dz, sum_z);
+
+        _mm512_storeu_pd(&ax[j], _mm512_fnmadd_pd(scale_j, dx, _mm512_loadu_pd(&ax[j])));
+        _mm512_storeu_pd(&ay[j], _mm512_fnmadd_pd(scale_j, dy, _mm512_loadu_pd(&ay[j])));
+        _mm512_storeu_pd(&az[j], _mm512_fnmadd_pd(scale_j, dz, _mm512_loadu_pd(&az[j])));
+    }
+
+    ax[i] += _mm512_reduce_add_pd(sum_x);
+    ay[i] += _mm512_reduce_add_pd(sum_y);
+    az[i] += _mm512_reduce_add_pd(sum_z);
+
+    gravity_row_scalar(bodies, i, j, j_end, ax, ay, az);
+}
+
+#endif
+
+// picks the widest vector kernel the cpu supports, call again after reproducible changes
+void init_simd()
+{
+    simd_level = SIMD_SCALAR;
+    gravity_row = gravity_row_scalar;
+    gravity_sum = gravity_sum_scalar;
+    ensemble_forces = ensemble_forces_scalar;
+
+#ifdef SIMD_KERNELS
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx512f"))
+    {
+        simd_level = SIMD_AVX512;
+        gravity_row = gravity_row_avx512;
+        gravity_sum = gravity_sum_avx512;
+        ensemble_forces = ensemble_forces_avx512;
+    }
+    else if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    {
+        simd_level = SIMD_AVX2;
+        gravity_row = gravity_row_avx2;
+        gravity_sum = gravity_sum_avx2;
+        ensemble_forces = ensemble_forces_avx2;
+    }
+    else if (__builtin_cpu_supports("sse2"))
+    {
+        simd_level = SIMD_SSE2;
+        gravity_row = gravity_row_sse2;
+        gravity_sum = gravity_sum_sse2;
+        ensemble_forces = ensemble_forces_sse2;
+    }
+
+    // the wider ensemble kernels fuse multiply-adds, each variant only matches the scalar kernel without them
+    if (reproducible && simd_level > SIMD_SSE2)
+    {
+        ensemble_forces = ensemble_forces_sse2;
+    }
+#endif
+}
+
+/*
+    reproducible mode
+
+    The threaded direct pass sums each body's pulls in whatever order the threads finish their
+    rows in, and the vector kernels split each row over as many lanes as they are wide and fuse
+    multiply-adds, so the last bits of a trajectory change with the thread count and the cpu.
+    In reproducible mode every body sums its own pulls from every massive body instead, in body
+    order, into REPRODUCIBLE_LANES partial sums that body j_start + k always lands in lane k of,
+    which are then added as one fixed tree. Each body is worked out by one thread on its own, and
+    every kernel does the same correctly rounded operations on the same lanes with no fused
+    multiply-adds, so the result does not depend on the threads or on the kernel. Newton's third
+    law is given up, so a pass costs up to twice the pair work of the serial one, but there are
+    no per-thread buffers to add up afterwards. With fewer massive bodies than lanes most lanes
+    would stay empty, so each body then adds its few pulls straight up in body order instead,
+    which is just as fixed. The other force solvers already work out each body on one thread in
+    a fixed order.
+*/
+// every body's pull from every massive body but itself, summed in a fixed order
+void apply_gravitational_forces_reproducible(Body_store *bodies)
+{
+    int n = bodies->count;
+    int sources = bodies->massive_count;
+
+    if (sources < REPRODUCIBLE_LANES)
+    {
+        OMP_PRAGMA(omp parallel for schedule(static) num_threads(pass_threads(n)))
+        for (int i = 0; i < n; i++)
+        {
+            gravity_sum_ordered(bodies, i, sources);
+        }
+        return;
+    }
+
+    OMP_PRAGMA(omp parallel for schedule(static) num_threads(pass_threads(n)))
+    for (int i = 0; i < n; i++)
+    {
+        double lanes[3][REPRODUCIBLE_LANES] = {{0.0}};
+
+        gravity_sum(bodies, i, 0, (i < sources) ? i : sources, lanes);
+        gravity_sum(bodies, i, i + 1, sources, lanes);
+
+        bodies->acceleration_x[i] = sum_lanes(lanes[0]);
+        bodies->acceleration_y[i] = sum_lanes(lanes[1]);
+        bodies->acceleration_z[i] = sum_lanes(lanes[2]);
+    }
+}
+
+// the pulls of the first sources bodies on body i added one after another, for passes with fewer sources than lanes
+__attribute__((optimize("fp-contract=off")))
+void gravity_sum_ordered(Body_store *bodies, int i, int sources)
+{
+    double ax = 0.0, ay = 0.0, az = 0.0;
+
+    for (int j = 0; j < sources; j++)
+    {
+        if (j == i)
+            continue;
+
+        double dx = bodies->position_x[j] - bodies->position_x[i];
+        double dy = bodies->position_y[j] - bodies->position_y[i];
+        double dz = bodies->position_z[j] - bodies->position_z[i];
+
+        double distance_squared = (dx * dx + dy * dy) + dz * dz;
+        double scale = bodies->gm[j] * (1.0 / (distance_squared * sqrt(distance_squared)));
+
+        ax += scale * dx;
+        ay += scale * dy;
+        az += scale * dz;
+    }
+
+    bodies->acceleration_x[i] = ax;
+    bodies->acceleration_y[i] = ay;
+    bodies->acceleration_z[i] = az;
+}
+
+// pairwise tree over the partial sums, the same order the vector kernels would reduce in
+double sum_lanes(const double lanes[REPRODUCIBLE_LANES])
+{
+    return ((lanes[0] + lanes[1]) + (lanes[2] + lanes[3])) + ((lanes[4] + lanes[5]) + (lanes[6] + lanes[7]));
+}
+
+// adds the pulls of bodies j_start .. j_end - 1 on body i, body j_start + k to lane k % REPRODUCIBLE_LANES,
+// without contraction so a build for a cpu with fused multiply-adds still matches the vector kernels
+__attribute__((optimize("fp-contract=off")))
+void gravity_sum_scalar(Body_store *bodies, int i, int j_start, int j_end, double lanes[3][REPRODUCIBLE_LANES])
+{
+    for (int j = j_start; j < j_end; j++)
+    {
+        int lane = (j - j_start) % REPRODUCIBLE_LANES;
+
+        double dx = bodies->position_x[j] - bodies->position_x[i];
+        double dy = bodies->position_y[j] - bodies->position_y[i];
+        double dz = bodies->position_z[j] - bodies->position_z[i];
+
+        double distance_squared = (dx * dx + dy * dy) + dz * dz;
+        double scale = bodies->gm[j] * (1.0 / (distance_squared * sqrt(distance_squared)));
+
+        lanes[0][lane] += scale * dx;
+        lanes[1][lane] += scale * dy;
+        lanes[2][lane] += scale * dz;
+    }
+}
+
+#ifdef SIMD_KERNELS
+
+// 2 bodies per instruction, 4 registers make up the 8 lanes
+__attribute__((target("sse2"), optimize("fp-contract=off")))
+void gravity_sum_sse2(Body_store *bodies, int i, int j_start, int j_end, double lanes[3][REPRODUCIBLE_LANES])
+{
+    __m128d xi = _mm_set1_pd(bodies->position_x[i]);
+    __m128d yi = _mm_set1_pd(bodies->position_y[i]);
+    __m128d zi = _mm_set1_pd(bodies->position_z[i]);
+    __m128d one = _mm_set1_pd(1.0);
+
+    __m128d sum_x[4], sum_y[4], sum_z[4];
+    for (int k = 0; k < 4; k++)
+    {
+        sum_x[k] = _mm_loadu_pd(&lanes[0][2 * k]);
+        sum_y[k] = _mm_loadu_pd(&lanes[1][2 * k]);
+        sum_z[k] = _mm_loadu_pd(&lanes[2][2 * k]);
+    }
+
+    int j = j_start;
+    for (; j + REPRODUCIBLE_LANES <= j_end; j += REPRODUCIBLE_LANES)
+    {
+        for (int k = 0; k < 4; k++)
+        {
+            __m128d dx = _mm_sub_pd(_mm_loadu_pd(&bodies->position_x[j + 2 * k]), xi);
+            __m128d dy = _mm_sub_pd(_mm_loadu_pd(&bodies->position_y[j + 2 * k]), yi);
+            __m128d dz = _mm_sub_pd(_mm_loadu_pd(&bodies->position_z[j + 2 * k]), zi);
+
+            __m128d distance_squared = _mm_add_pd(_mm_add_pd(_mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy)), _mm_mul_pd(dz, dz));
+            __m128d inverse_cube = _mm_div_pd(one, _mm_mul_pd(distance_squared, _mm_sqrt_pd(distance_squared)));
+            __m128d scale = _mm_mul_pd(_mm_loadu_pd(&bodies->gm[j + 2 * k]), inverse_cube);
+
+            sum_x[k] = _mm_add_pd(sum_x[k], _mm_mul_pd(scale, dx));
+            sum_y[k] = _mm_add_pd(sum_y[k], _mm_mul_pd(scale, dy));
+            sum_z[k] = _mm_add_pd(sum_z[k], _mm_mul_pd(scale, dz));
+        }
+    }
+
+    for (int k = 0; k < 4; k++)
+    {
+        _mm_storeu_pd(&lanes[0][2 * k], sum_x[k]);
+        _mm_storeu_pd(&lanes[1][2 * k], sum_y[k]);
+        _mm_storeu_pd(&lanes[2][2 * k], sum_z[k]);
+    }
+
+    // the tail starts on lane 0 again, as j - j_start is a whole number of vectors here
+    gravity_sum_scalar(bodies, i, j, j_end, lanes);
+}
+
+// 4 bodies per instruction, 2 registers make up the 8 lanes
+__attribute__((target("avx2"), optimize("fp-contract=off")))
+void gravity_sum_avx2(Body_store *bodies, int i, int j_start, int j_end, double lanes[3][REPRODUCIBLE_LANES])
+{
+    __m256d xi = _mm256_set1_pd(bodies->position_x[i]);
+    __m256d yi = _mm256_set1_pd(bodies->position_y[i]);
+    __m256d zi = _mm256_set1_pd(bodies->position_z[i]);
+    __m256d one = _mm256_set1_pd(1.0);
+
+    __m256d sum_x[2], sum_y[2], sum_z[2];
+    for (int k = 0; k < 2; k++)
+    {
+        sum_x[k] = _mm256_loadu_pd(&lanes[0][4 * k]);
+        sum_y[k] = _mm256_loadu_pd(&lanes[1][4 * k]);
+        sum_z[k] = _mm256_loadu_pd(&lanes[2][4 * k]);
+    }
+
+    int j = j_start;
+    for (; j + REPRODUCIBLE_LANES <= j_end; j += REPRODUCIBLE_LANES)
+    {
+        for (int k = 0; k < 2; k++)
+        {
+            __m256d dx = _mm256_sub_pd(_mm256_loadu_pd(&bodies->position_x[j + 4 * k]), xi);
+            __m256d dy = _mm256_sub_pd(_mm256_loadu_pd(&bodies->position_y[j + 4 * k]), yi);
+            __m256d dz = _mm256_sub_pd(_mm256_loadu_pd(&bodies->position_z[j + 4 * k]), zi);
+
+            __m256d distance_squared = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy)), _mm256_mul_pd(dz, dz));
+            __m256d inverse_cube = _mm256_div_pd(one, _mm256_mul_pd(distance_squared, _mm256_sqrt_pd(distance_squared)));
+            __m256d scale = _mm256_mul_pd(_mm256_loadu_pd(&bodies->gm[j + 4 * k]), inverse_cube);
+
+            sum_x[k] = _mm256_add_pd(sum_x[k], _mm256_mul_pd(scale, dx));
+            sum_y[k] = _mm256_add_pd(sum_y[k], _mm256_mul_pd(scale, dy));
+            sum_z[k] = _mm256_add_pd(sum_z[k], _mm256_mul_pd(scale, dz));
+        }
+    }
+
+    for (int k = 0; k < 2; k++)
+    {
+        _mm256_storeu_pd(&lanes[0][4 * k], sum_x[k]);
+        _mm256_storeu_pd(&lanes[1][4 * k], sum_y[k]);
+        _mm256_storeu_pd(&lanes[2][4 * k], sum_z[k]);
+    }
+
+    gravity_sum_scalar(bodies, i, j, j_end, lanes);
+}
+
+// 8 bodies per instruction, one register holds all the lanes
+__attribute__((target("avx512f"), optimize("fp-contract=off")))
+void gravity_sum_avx512(Body_store *bodies, int i, int j_start, int j_end, double lanes[3][REPRODUCIBLE_LANES])
+{
+    __m512d xi = _mm512_set1_pd(bodies->position_x[i]);
+    __m512d yi = _mm512_set1_pd(bodies->position_y[i]);
+    __m512d zi = _mm512_set1_pd(bodies->position_z[i]);
+    __m512d one = _mm512_set1_pd(1.0);
+
+    __m512d sum_x = _mm512_loadu_pd(lanes[0]);
+    __m512d sum_y = _mm512_loadu_pd(lanes[1]);
+    __m512d sum_z = _mm512_loadu_pd(lanes[2]);
+
+    int j = j_start;
+    for (; j + REPRODUCIBLE_LANES <= j_end; j += REPRODUCIBLE_LANES)
+    {
+        __m512d dx = _mm512_sub_pd(_mm512_loadu_pd(&bodies->position_x[j]), xi);
+        __m512d dy = _mm512_sub_pd(_mm512_loadu_pd(&bodies->position_y[j]), yi);
+        __m512d dz = _mm512_sub_pd(_mm512_loadu_pd(&bodies->position_z[j]), zi);
+
+        __m512d distance_squared = _mm512_add_pd(_mm512_add_pd(_mm512_mul_pd(dx, dx), _mm512_mul_pd(dy, dy)), _mm512_mul_pd(dz, dz));
+        __m512d inverse_cube = _mm512_div_pd(one, _mm512_mul_pd(distance_squared, _mm512_sqrt_pd(distance_squared)));
+        __m512d scale = _mm512_mul_pd(_mm512_loadu_pd(&bodies->gm[j]), inverse_cube);
+
+        sum_x = _mm512_add_pd(sum_x, _mm512_mul_pd(scale, dx));
+        sum_y = _mm512_add_pd(sum_y, _mm512_mul_pd(scale, dy));
+        sum_z = _mm512_add_pd(sum_z, _mm512_mul_pd(scale, dz));
+    }
+
+    _mm512_storeu_pd(lanes[0], sum_x);
+    _mm512_storeu_pd(lanes[1], sum_y);
+    _mm512_storeu_pd(lanes[2], sum_z);
+
+    gravity_sum_scalar(bodies, i, j, j_end, lanes);
+}
+
+#endif
+
+/*
+    small n kernels
+
+    Systems of up to MAX_SMALL_N bodies spend more time on loop control and on going through
+    memory than on arithmetic. Each size gets its own copy of the force pass and of the fused
+    leapfrog step below. n is a constant there, so up to SMALL_UNROLL_LIMIT bodies the compiler
+    unrolls every loop completely and no branches are left, above it only the inner loop is
+    unrolled. SMALL_SIZES lists the sizes that get a copy, and any other size takes the generic path.
+*/
+// distances squared are never negative, so the errno check and libm call sqrt carries are dead code,
+// which would otherwise take up a third of a fully unrolled kernel
+static inline __attribute__((always_inline))
+double small_sqrt(double x)
+{
+#ifdef SIMD_KERNELS
+    return _mm_cvtsd_f64(_mm_sqrt_sd(_mm_setzero_pd(), _mm_set_sd(x)));
+#else
+    return sqrt(x);
+#endif
+}
+
+// pull between bodies i and j of the local arrays
+static inline __attribute__((always_inline))
+void small_pair(int i, int j, const double *px, const double *py, const double *pz, const double *gm, double *ax, double *ay, double *az)
+{
+    double rx = px[j] - px[i];
+    double ry = py[j] - py[i];
+    double rz = pz[j] - pz[i];
+    double distance_squared = rx * rx + ry * ry + rz * rz;
+    double inverse_cube = 1.0 / (distance_squared * small_sqrt(distance_squared));
+    double scale_i = gm[j] * inverse_cube;
+    double scale_j = gm[i] * inverse_cube;
+
+    ax[i] += scale_i * rx; ay[i] += scale_i * ry; az[i] += scale_i * rz;
+    ax[j] -= scale_j * rx; ay[j] -= scale_j * ry; az[j] -= scale_j * rz;
+}
+
+// pulls between every pair of n bodies held in local arrays, n is a constant so only one of the loop nests is kept
+static inline __attribute__((always_inline))
+void small_accelerations(const int n, const double *px, const double *py, const double *pz, const double *gm, double *ax, double *ay, double *az)
+{
+    #pragma GCC unroll 16
+    for (int i = 0; i < n; i++)
+    {
+        ax[i] = 0.0;
+        ay[i] = 0.0;
+        az[i] = 0.0;
+    }
+
+    if (n <= SMALL_UNROLL_LIMIT)
+    {
+        #pragma GCC unroll 16
+        for (int i = 0; i < n; i++)
+        {
+            #pragma GCC unroll 16
+            for (int j = i + 1; j < n; j++)
+            {
+                small_pair(i, j, px, py, pz, gm, ax, ay, az);
+            }
+        }
+    }
+    else
+    {
+        for (int i = 0; i < n; i++)
+        {
+            #pragma GCC unroll 4
+            for (int j = i + 1; j < n; j++)
+            {
+                small_pair(i, j, px, py, pz, gm, ax, ay, az);
+            }
+        }
+    }
+}
+
+// one direct force pass
+static inline __attribute__((always_inline))
+void small_forces(Body_store *bodies, const int n)
+{
+    small_accelerations(n, bodies->position_x, bodies->position_y, bodies->position_z, bodies->gm,
+                        bodies->acceleration_x, bodies->acceleration_y, bodies->acceleration_z);
+}
+
+// one leapfrog step done on local copies, the body store is only read at the start and written at the end
+static inline __attribute__((always_inline))
+void small_leapfrog(Body_store *bodies, double dt, const int n)
+{
+    double px[MAX_SMALL_N], py[MAX_SMALL_N], pz[MAX_SMALL_N];
+    double vx[MAX_SMALL_N], vy[MAX_SMALL_N], vz[MAX_SMALL_N];
+    double ax[MAX_SMALL_N], ay[MAX_SMALL_N], az[MAX_SMALL_N];
+    double gm[MAX_SMALL_N];
+
+    #pragma GCC unroll 16
+    for (int i = 0; i < n; i++)
+    {
+        px[i] = bodies->position_x[i]; py[i] = bodies->position_y[i]; pz[i] = bodies->position_z[i];
+        vx[i] = bodies->velocity_x[i]; vy[i] = bodies->velocity_y[i]; vz[i] = bodies->velocity_z[i];
+        gm[i] = bodies->gm[i];
+
+        vx[i] += bodies->acceleration_x[i] * dt / 2;
+        vy[i] += bodies->acceleration_y[i] * dt / 2;
+        vz[i] += bodies->acceleration_z[i] * dt / 2;
+
+        px[i] += vx[i] * dt; py[i] += vy[i] * dt; pz[i] += vz[i] * dt;
+    }
+
+    small_accelerations(n, px, py, pz, gm, ax, ay, az);
+
+    #pragma GCC unroll 16
+    for (int i = 0; i < n; i++)
+    {
+        vx[i] += ax[i] * dt / 2; vy[i] += ay[i] * dt / 2; vz[i] += az[i] * dt / 2;
+
+        bodies->position_x[i] = px[i]; bodies->position_y[i] = py[i]; bodies->position_z[i] = pz[i];
+        bodies->velocity_x[i] = vx[i]; bodies->velocity_y[i] = vy[i]; bodies->velocity_z[i] = vz[i];
+        bodies->acceleration_x[i] = ax[i]; bodies->acceleration_y[i] = ay[i]; bodies->acceleration_z[i] = az[i];
+    }
+}
+
+// one copy of each kernel per size, small_forces_2 ... small_forces_16 and small_leapfrog_2 ... small_leapfrog_16
+#define SMALL_KERNELS(N) \
+    void small_forces_##N(Body_store *bodies) { small_forces(bodies, N); } \
+    void small_leapfrog_##N(Body_store *bodies, double dt) { small_leapfrog(bodies, dt, N); }
+SMALL_SIZES(SMALL_KERNELS)
+#undef SMALL_KERNELS
+
+// the kernels visit every pair, which matches the direct pass as long as no two bodies are both test particles
+bool small_kernel_fits(Body_store *bodies)
+{
+    int n = bodies->count;
+    return n >= 2 && n <= MAX_SMALL_N && bodies->massive_count >= n - 1;
+}
+
+/*
+    barnes-hut
+*/
+// approximates the gravitational forces on all bodies by walking an octree, O(N log N)
+void apply_gravitational_forces_barnes_hut(Body_store *bodies)
+{
+    Chunk *root = build_octree(bodies, bodies->massive_count);
+
+    // every body only writes its own acceleration, so the walks need no per-thread buffers
+    OMP_PRAGMA(omp parallel for schedule(dynamic, 64) num_threads(pass_threads(bodies->count)))
+    for (int i = 0; i < bodies->count; i++)
+    {
+        Vec3 acceleration = chunk_acceleration(root, bodies, i);
+
+        bodies->acceleration_x[i] = acceleration.x;
+        bodies->acceleration_y[i] = acceleration.y;
+        bodies->acceleration_z[i] = acceleration.z;
+    }
+}
+
+// builds the octree of the first count bodies, growing the chunk pool whenever it runs out.
+// Barnes-Hut leaves the test particles out, they pull on nothing
+Chunk *build_octree(Body_store *bodies, int count)
+{
+    Octree *octree = &bodies->octree;
+    int n = bodies->count;
+    Vec3 min, max;
+    Chunk *root;
+
+    if (octree->no_bodies != n)
+    {
+        free(octree->order);
+        free(octree->slot);
+        free(octree->octant);
+        free(octree->sorted);
+
+        octree->order = malloc(n * sizeof(int));
+        octree->slot = malloc(n * sizeof(int));
+        octree->octant = malloc(n * sizeof(int));
+        octree->sorted = malloc(n * sizeof(int));
+        if (!octree->order || !octree->slot || !octree->octant || !octree->sorted)
+        {
+            perror("malloc failed");
+            exit(EXIT_FAILURE);
+        }
+        octree->no_bodies = n;
+    }
+
+    // bounding cube of the bodies in the tree, bodies outside it are still walked from the root
+    min = max = (Vec3){bodies->position_x[0], bodies->position_y[0], bodies->position_z[0]};
+    for (int i = 0; i < count; i++)
+    {
+        min.x = fmin(min.x, bodies->position_x[i]); max.x = fmax(max.x, bodies->position_x[i]);
+        min.y = fmin(min.y, bodies->position_y[i]); max.y = fmax(max.y, bodies->position_y[i]);
+        min.z = fmin(min.z, bodies->position_z[i]); max.z = fmax(max.z, bodies->position_z[i]);
+    }
+
+    Vec3 centre = {(min.x + max.x) / 2, (min.y + max.y) / 2, (min.z + max.z) / 2};
+    double half_size = fmax(max.x - min.x, fmax(max.y - min.y, max.z - min.z)) / 2;
+    half_size = half_size * 1.0001 + 1.0; // keeps bodies on the boundary strictly inside
+
+    do
+    {
+        if (octree->used < 0 || octree->pool_size == 0)
+        {
+            octree->pool_size = (octree->pool_size == 0) ? 2 * n + 64 : octree->pool_size * 2;
+            free(octree->pool);
+            octree->pool = malloc(octree->pool_size * sizeof(Chunk));
+            if (!octree->pool)
+            {
+                perror("malloc failed");
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        for (int i = 0; i < count; i++)
+        {
+            octree->order[i] = i;
+        }
+
+        octree->used = 0;
+        root = build_chunk(bodies, centre, half_size, 0, count, 0);
+
+    } while (root == NULL); // pool ran out, build_chunk set used to -1
+
+    // bodies left out are in no chunk
+    for (int i = count; i < n; i++)
+    {
+        octree->slot[i] = -1;
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        octree->slot[octree->order[i]] = i;
+    }
+
+    return root;
+}
+
+// creates the chunk holding order[first .. first + count) and recursively splits it into octants
+Chunk *build_chunk(Body_store *bodies, Vec3 centre, double half_size, int first, int count, int depth)
+{
+    Octree *octree = &bodies->octree;
+
+    if (octree->used < 0)
+        return NULL;
+
+    if (octree->used >= octree->pool_size)
+    {
+        octree->used = -1;
+        return NULL;
+    }
+
+    Chunk *chunk = &octree->pool[octree->used++];
+    chunk->centre = centre;
+    chunk->half_size = half_size;
+    chunk->first = first;
+    chunk->count = count;
+    chunk->mass = 0.0;
+    chunk->centre_of_mass = (Vec3){0.0, 0.0, 0.0};
+    chunk->leaf = (count <= CHUNK_CAPACITY || depth >= MAX_CHUNK_DEPTH);
+
+    for (int x = 0; x < 2; x++)
+        for (int y = 0; y < 2; y++)
+            for (int z = 0; z < 2; z++)
+                chunk->child[x][y][z] = NULL;
+
+    if (chunk->leaf)
+    {
+        for (int i = first; i < first + count; i++)
+        {
+            int b = octree->order[i];
+            chunk->mass += bodies->mass[b];
+            chunk->centre_of_mass.x += bodies->mass[b] * bodies->position_x[b];
+            chunk->centre_of_mass.y += bodies->mass[b] * bodies->position_y[b];
+            chunk->centre_of_mass.z += bodies->mass[b] * bodies->position_z[b];
+        }
+    }
+    else
+    {
+        // counting sort of the bodies into their octants
+        int octant_count[8] = {0};
+        int octant_first[8];
+
+        for (int i = first; i < first + count; i++)
+        {
+            int b = octree->order[i];
+            int octant = (bodies->position_x[b] >= centre.x) * 4 + (bodies->position_y[b] >= centre.y) * 2 + (bodies->position_z[b] >= centre.z);
+            octree->octant[i] = octant;
+            octant_count[octant]++;
+        }
+
+        octant_first[0] = first;
+        for (int o = 1; o < 8; o++)
+        {
+            octant_first[o] = octant_first[o - 1] + octant_count[o - 1];
+        }
+
+        int fill[8];
+        memcpy(fill, octant_first, sizeof(fill));
+
+        for (int i = first; i < first + count; i++)
+        {
+            octree->sorted[fill[octree->octant[i]]++] = octree->order[i];
+        }
+        memcpy(&octree->order[first], &octree->sorted[first], count * sizeof(int));
+
+        double quarter = half_size / 2;
+        for (int o = 0; o < 8; o++)
+        {
+            if (octant_count[o] == 0)
+                continue;
+
+            int x = (o >> 2) & 1, y = (o >> 1) & 1, z = o & 1;
+            Vec3 child_centre = {
+                centre.x + (x ? quarter : -quarter),
+                centre.y + (y ? quarter : -quarter),
+                centre.z + (z ? quarter : -quarter)};
+
+            Chunk *child = build_chunk(bodies, child_centre, quarter, octant_first[o], octant_count[o], depth + 1);
+            if (child == NULL)
+                return NULL;
+
+            chunk->child[x][y][z] = child;
+            chunk->mass += child->mass;
+            chunk->centre_of_mass.x += child->mass * child->centre_of_mass.x;
+            chunk->centre_of_mass.y += child->mass * child->centre_of_mass.y;
+            chunk->centre_of_mass.z += child->mass * child->centre_of_mass.z;
+        }
+    }
+
+    if (chunk->mass > 0)
+    {
+        chunk->centre_of_mass.x /= chunk->mass;
+        chunk->centre_of_mass.y /= chunk->mass;
+        chunk->centre_of_mass.z /= chunk->mass;
+    }
+    else
+    {
+        chunk->centre_of_mass = centre;
+    }
+
+    return chunk;
+}
+
+// gravitational acceleration of the target body from every body inside a chunk
+Vec3 chunk_acceleration(Chunk *chunk, Body_store *bodies, int target)
+{
+    Octree *octree = &bodies->octree;
+    Vec3 acceleration = {0.0, 0.0, 0.0};
+    Vec3 p = {bodies->position_x[target], bodies->position_y[target], bodies->position_z[target]};
+
+    if (chunk->leaf)
+    {
+        for (int i = chunk->first; i < chunk->first + chunk->count; i++)
+        {
+            int j = octree->order[i];
+            if (j == target)
+                continue;
+
+            Vec3 r = {
+                bodies->position_x[j] - p.x,
+                bodies->position_y[j] - p.y,
+                bodies->position_z[j] - p.z};
+
+            double distance_squared = r.x * r.x + r.y * r.y + r.z * r.z;
+            double scale = bodies->gm[j] / (distance_squared * sqrt(distance_squared));
+
+            acceleration.x += scale * r.x;
+            acceleration.y += scale * r.y;
+            acceleration.z += scale * r.z;
+        }
+
+        return acceleration;
+    }
+
+    Vec3 r = {
+        chunk->centre_of_mass.x - p.x,
+        chunk->centre_of_mass.y - p.y,
+        chunk->centre_of_mass.z - p.z};
+
+    double distance = sqrt(r.x * r.x + r.y * r.y + r.z * r.z);
+    int slot = octree->slot[target];
+    bool contains_target = (slot >= chunk->first && slot < chunk->first + chunk->count);
+
+    // far enough away, the whole chunk acts like one body at its centre of mass
+    if (!contains_target && (2 * chunk->half_size) < opening_angle * distance)
+    {
+        double scale = (GRAVITATIONAL_CONSTANT * chunk->mass) / (distance * distance * distance);
+
+        acceleration.x = scale * r.x;
+        acceleration.y = scale * r.y;
+        acceleration.z = scale * r.z;
+
+        return acceleration;
+    }
+
+    for (int x = 0; x < 2; x++)
+        for (int y = 0; y < 2; y++)
+            for (int z = 0; z < 2; z++)
+            {
+                if (chunk->child[x][y][z] == NULL)
+                    continue;
+
+                Vec3 child_acceleration = chunk_acceleration(chunk->child[x][y][z], bodies, target);
+                acceleration.x += child_acceleration.x;
+                acceleration.y += child_acceleration.y;
+                acceleration.z += child_acceleration.z;
+            }
+
+    return acceleration;
+}
+
+/*
+    fast multipole
+
+    Cartesian fast multipole method on the Barnes-Hut octree. Every chunk gets a multipole
+    expansion about its centre of mass, the raw moments sum(gm * d^alpha) up to fmm_order, and a
+    local Taylor expansion of the potential. A dual tree walk turns each pair of well separated
+    chunks into two multipole to local translations, using the Taylor coefficients of 1 / r from
+    their recurrence, and sums nearby leaves pair by pair. The local expansions are then pushed
+    down to the bodies. For a fixed order and opening angle the number of translations grows as
+    O(N), but the tree is built in O(N log N) and the walks miss the cache more as N grows.
+
+    The passes are OpenMP tasks over subtrees of at least FMM_TASK_BODIES bodies. Up and down
+    the tree every child is a task. The walk pairs up children in rounds where no child is in
+    two pairs, so the tasks of a round never touch the same chunk, expansion or body. The
+    rounds only depend on the tree, so the sums come out the same on any number of threads.
+*/
+// approximates the gravitational forces on all bodies with the fast multipole method
+void apply_gravitational_forces_fmm(Body_store *bodies)
+{
+    Octree *octree = &bodies->octree;
+    Fmm *fmm = &bodies->fmm;
+    int n = bodies->count;
+
+    // every body goes in the tree, test particles simply carry no mass
+    Chunk *root = build_octree(bodies, n);
+    init_fmm(bodies, fmm_order, octree->pool_size);
+
+    memset(bodies->acceleration_x, 0, n * sizeof(double));
+    memset(bodies->acceleration_y, 0, n * sizeof(double));
+    memset(bodies->acceleration_z, 0, n * sizeof(double));
+    memset(fmm->local, 0, (size_t)octree->used * fmm->terms * sizeof(double));
+
+    OMP_PRAGMA(omp parallel num_threads(pass_threads(n)))
+    OMP_PRAGMA(omp single)
+    {
+        fmm_upward(root, bodies);
+        fmm_self(root, bodies);
+        fmm_downward(root, bodies);
+    }
+}
+
+// builds the multi-index tables for an expansion order and sizes the expansions for the chunk pool
+void init_fmm(Body_store *bodies, int order, int chunks)
+{
+    Fmm *fmm = &bodies->fmm;
+
+    if (fmm->order != order)
+    {
+        int terms = (order + 1) * (order + 2) * (order + 3) / 6;
+
+        free(fmm->power);
+        free(fmm->index);
+        free(fmm->sum);
+        free(fmm->m2l);
+        fmm->power = malloc(3 * terms * sizeof(int));
+        fmm->index = malloc((order + 1) * (order + 1) * (order + 1) * sizeof(int));
+        fmm->sum = malloc(terms * terms * sizeof(int));
+        fmm->m2l = malloc(terms * terms * sizeof(double));
+        if (!fmm->power || !fmm->index || !fmm->sum || !fmm->m2l)
+        {
+            perror("malloc failed");
+            exit(EXIT_FAILURE);
+        }
+
+        // terms in order of degree, so the recurrence only looks back
+        int term = 0;
+        for (int degree = 0; degree <= order; degree++)
+            for (int x = degree; x >= 0; x--)
+                for (int y = degree - x; y >= 0; y--)
+                {
+                    int z = degree - x - y;
+                    fmm->power[3 * term] = x;
+                    fmm->power[3 * term + 1] = y;
+                    fmm->power[3 * term + 2] = z;
+                    fmm->index[(x * (order + 1) + y) * (order + 1) + z] = term;
+                    term++;
+                }
+
+        for (int k = 0; k <= order; k++)
+        {
+            fmm->choose[k][0] = 1.0;
+            for (int j = 1; j <= k; j++)
+            {
+                fmm->choose[k][j] = fmm->choose[k][j - 1] * (k - j + 1) / j;
+            }
+        }
+
+        // (-1)^|alpha| (alpha + beta choose alpha) and where alpha + beta lives
+        for (int a = 0; a < terms; a++)
+            for (int b = 0; b < terms; b++)
+            {
+                int *pa = &fmm->power[3 * a], *pb = &fmm->power[3 * b];
+                int degree = pa[0] + pa[1] + pa[2] + pb[0] + pb[1] + pb[2];
+
+                if (degree > order)
+                {
+                    fmm->sum[a * terms + b] = -1;
+                    fmm->m2l[a * terms + b] = 0.0;
+                    continue;
+                }
+
+                fmm->sum[a * terms + b] = fmm->index[((pa[0] + pb[0]) * (order + 1) + pa[1] + pb[1]) * (order + 1) + pa[2] + pb[2]];
+                fmm->m2l[a * terms + b] = ((pa[0] + pa[1] + pa[2]) % 2 ? -1.0 : 1.0) *
+                                         fmm->choose[pa[0] + pb[0]][pa[0]] * fmm->choose[pa[1] + pb[1]][pa[1]] * fmm->choose[pa[2] + pb[2]][pa[2]];
+            }
+
+        fmm->order = order;
+        fmm->terms = terms;
+        fmm->direct_pairs = terms * terms / FMM_PAIR_COST;
+        fmm->chunks = 0;
+    }
+
+    if (fmm->chunks < chunks)
+    {
+        free(fmm->multipole);
+        free(fmm->local);
+        free(fmm->radius);
+        fmm->multipole = malloc((size_t)chunks * fmm->terms * sizeof(double));
+        fmm->local = malloc((size_t)chunks * fmm->terms * sizeof(double));
+        fmm->radius = malloc(chunks * sizeof(double));
+        if (!fmm->multipole || !fmm->local || !fmm->radius)
+        {
+            perror("malloc failed");
+            exit(EXIT_FAILURE);
+        }
+        fmm->chunks = chunks;
+    }
+}
+
+// x, y and z powers of a vector up to the expansion order
+void fmm_powers(Vec3 d, int order, double powers[3][MAX_FMM_ORDER + 1])
+{
+    powers[0][0] = powers[1][0] = powers[2][0] = 1.0;
+
+    for (int k = 1; k <= order; k++)
+    {
+        powers[0][k] = powers[0][k - 1] * d.x;
+        powers[1][k] = powers[1][k - 1] * d.y;
+        powers[2][k] = powers[2][k - 1] * d.z;
+    }
+}
+
+// the eight children of a chunk in x, y, z order, NULL where there is none
+void fmm_children(Chunk *chunk, Chunk *children[8])
+{
+    for (int k = 0; k < 8; k++)
+    {
+        children[k] = chunk->child[k >> 2][(k >> 1) & 1][k & 1];
+    }
+}
+
+// multipoles and radii from the leaves up, shifting every child's moments to its parent's centre of mass
+void fmm_upward(Chunk *chunk, Body_store *bodies)
+{
+    Octree *octree = &bodies->octree;
+    Fmm *fmm = &bodies->fmm;
+    int terms = fmm->terms;
+    size_t slot = chunk - octree->pool;
+    double *multipole = &fmm->multipole[slot * terms];
+    Vec3 centre = chunk->centre_of_mass;
+    double powers[3][MAX_FMM_ORDER + 1];
+
+    memset(multipole, 0, terms * sizeof(double));
+    fmm->radius[slot] = 0.0;
+
+    if (chunk->leaf)
+    {
+        for (int k = chunk->first; k < chunk->first + chunk->count; k++)
+        {
+            int i = octree->order[k];
+            Vec3 d = {bodies->position_x[i] - centre.x, bodies->position_y[i] - centre.y, bodies->position_z[i] - centre.z};
+
+            fmm_powers(d, fmm->order, powers);
+            for (int a = 0; a < terms; a++)
+            {
+                int *p = &fmm->power[3 * a];
+                multipole[a] += bodies->gm[i] * powers[0][p[0]] * powers[1][p[1]] * powers[2][p[2]];
+            }
+
+            fmm->radius[slot] = fmax(fmm->radius[slot], sqrt(d.x * d.x + d.y * d.y + d.z * d.z));
+        }
+
+        return;
+    }
+
+    Chunk *children[8];
+    fmm_children(chunk, children);
+
+    for (int k = 0; k < 8; k++)
+    {
+        if (children[k] != NULL)
+        {
+            OMP_PRAGMA(omp task if(children[k]->count >= FMM_TASK_BODIES))
+            fmm_upward(children[k], bodies);
+        }
+    }
+    OMP_PRAGMA(omp taskwait)
+
+    for (int x = 0; x < 2; x++)
+        for (int y = 0; y < 2; y++)
+            for (int z = 0; z < 2; z++)
+            {
+                Chunk *child = chunk->child[x][y][z];
+                if (child == NULL)
+                    continue;
+
+                size_t child_slot = child - octree->pool;
+                double *child_multipole = &fmm->multipole[child_slot * terms];
+                Vec3 s = {child->centre_of_mass.x - centre.x, child->centre_of_mass.y - centre.y, child->centre_of_mass.z - centre.z};
+                double shift = sqrt(s.x * s.x + s.y * s.y + s.z * s.z);
+
+                fmm->radius[slot] = fmax(fmm->radius[slot], shift + fmm->radius[child_slot]);
+
+                // sum(gm * (d + s)^alpha) = sum over gamma <= alpha of (alpha choose gamma) s^(alpha - gamma) moment_gamma
+                fmm_powers(s, fmm->order, powers);
+                for (int a = 0; a < terms; a++)
+                {
+                    int *pa = &fmm->power[3 * a];
+
+                    for (int g = 0; g <= a; g++)
+                    {
+                        int *pg = &fmm->power[3 * g];
+                        if (pg[0] > pa[0] || pg[1] > pa[1] || pg[2] > pa[2])
+                            continue;
+
+                        multipole[a] += fmm->choose[pa[0]][pg[0]] * fmm->choose[pa[1]][pg[1]] * fmm->choose[pa[2]][pg[2]] *
+                                        powers[0][pa[0] - pg[0]] * powers[1][pa[1] - pg[1]] * powers[2][pa[2] - pg[2]] * child_multipole[g];
+                    }
+                }
+            }
+
+    // no body is further out than the corners of the chunk
+    double corner = chunk->half_size * sqrt(3.0) + sqrt(pow(centre.x - chunk->centre.x, 2) + pow(centre.y - chunk->centre.y, 2) + pow(centre.z - chunk->centre.z, 2));
+    fmm->radius[slot] = fmin(fmm->radius[slot], corner);
+}
+
+// Taylor coefficients of 1 / |r + h| in h, from
+// |k| r^2 T_k + (2|k| - 1) sum_i r_i T_(k - e_i) + (|k| - 1) sum_i T_(k - 2 e_i) = 0
+void fmm_taylor_coefficients(Body_store *bodies, Vec3 r, double *taylor)
+{
+    Fmm *fmm = &bodies->fmm;
+    int order = fmm->order;
+    double r_vector[3] = {r.x, r.y, r.z};
+    double distance_squared = r.x * r.x + r.y * r.y + r.z * r.z;
+
+    taylor[0] = 1.0 / sqrt(distance_squared);
+
+    for (int k = 1; k < fmm->terms; k++)
+    {
+        int *p = &fmm->power[3 * k];
+        int degree = p[0] + p[1] + p[2];
+        double sum = 0.0;
+
+        for (int d = 0; d < 3; d++)
+        {
+            int lower[3] = {p[0], p[1], p[2]};
+
+            if (lower[d] >= 1)
+            {
+                lower[d] -= 1;
+                sum += (2 * degree - 1) * r_vector[d] * taylor[fmm->index[(lower[0] * (order + 1) + lower[1]) * (order + 1) + lower[2]]];
+            }
+
+            if (lower[d] >= 1)
+            {
+                lower[d] -= 1;
+                sum += (degree - 1) * taylor[fmm->index[(lower[0] * (order + 1) + lower[1]) * (order + 1) + lower[2]]];
+            }
+        }
+
+        taylor[k] = -sum / (degree * distance_squared);
+    }
+}
+
+// both multipole to local translations between two well separated chunks, sharing one set of Taylor coefficients
+void fmm_translate(Body_store *bodies, Chunk *a, Chunk *b)
+{
+    Octree *octree = &bodies->octree;
+    Fmm *fmm = &bodies->fmm;
+    int terms = fmm->terms;
+    double taylor[MAX_FMM_TERMS];
+    double *multipole_a = &fmm->multipole[(size_t)(a - octree->pool) * terms];
+    double *multipole_b = &fmm->multipole[(size_t)(b - octree->pool) * terms];
+    double *local_a = &fmm->local[(size_t)(a - octree->pool) * terms];
+    double *local_b = &fmm->local[(size_t)(b - octree->pool) * terms];
+
+    Vec3 r = {
+        a->centre_of_mass.x - b->centre_of_mass.x,
+        a->centre_of_mass.y - b->centre_of_mass.y,
+        a->centre_of_mass.z - b->centre_of_mass.z};
+
+    fmm_taylor_coefficients(bodies, r, taylor);
+
+    // seen from b the separation flips, which flips the sign of the odd degree coefficients
+    for (int beta = 0; beta < terms; beta++)
+    {
+        int *p = &fmm->power[3 * beta];
+        double beta_sign = ((p[0] + p[1] + p[2]) % 2) ? -1.0 : 1.0;
+        double sum_a = 0.0, sum_b = 0.0;
+
+        for (int alpha = 0; alpha < terms; alpha++)
+        {
+            int total = fmm->sum[alpha * terms + beta];
+            if (total < 0)
+                break; // terms are in order of degree, so every later alpha is past the order too
+
+            double coefficient = fmm->m2l[alpha * terms + beta] * taylor[total];
+
+            sum_a += coefficient * multipole_b[alpha];
+
+            // (-1)^(|alpha| + |beta|) on top of the (-1)^|alpha| already in the table
+            int *power_alpha = &fmm->power[3 * alpha];
+            double alpha_sign = ((power_alpha[0] + power_alpha[1] + power_alpha[2]) % 2) ? -1.0 : 1.0;
+            sum_b += coefficient * alpha_sign * multipole_a[alpha];
+        }
+
+        local_a[beta] += sum_a;
+        local_b[beta] += beta_sign * sum_b;
+    }
+}
+
+// every pair of bodies between two chunks, or within one chunk when a and b are the same
+void fmm_leaf_pairs(Chunk *a, Chunk *b, Body_store *bodies)
+{
+    Octree *octree = &bodies->octree;
+
+    for (int k = a->first; k < a->first + a->count; k++)
+    {
+        int start = (a == b) ? k + 1 : b->first;
+
+        for (int l = start; l < b->first + b->count; l++)
+        {
+            apply_gravitational_forces(bodies, octree->order[k], octree->order[l], bodies->acceleration_x, bodies->acceleration_y, bodies->acceleration_z);
+        }
+    }
+}
+
+// dual tree walk between two different chunks, splitting the larger one until the pair is well separated
+void fmm_interact(Chunk *a, Chunk *b, Body_store *bodies)
+{
+    Octree *octree = &bodies->octree;
+    Fmm *fmm = &bodies->fmm;
+    double radius_a = fmm->radius[a - octree->pool];
+    double radius_b = fmm->radius[b - octree->pool];
+
+    Vec3 r = {
+        a->centre_of_mass.x - b->centre_of_mass.x,
+        a->centre_of_mass.y - b->centre_of_mass.y,
+        a->centre_of_mass.z - b->centre_of_mass.z};
+    double distance = sqrt(r.x * r.x + r.y * r.y + r.z * r.z);
+
+    // a translation costs about as much as fmm->direct_pairs pairs, so small chunks are summed directly
+    if ((long long)a->count * b->count <= fmm->direct_pairs)
+    {
+        fmm_leaf_pairs(a, b, bodies);
+        return;
+    }
+
+    if (radius_a + radius_b < opening_angle * distance)
+    {
+        fmm_translate(bodies, a, b);
+        return;
+    }
+
+    if (a->leaf && b->leaf)
+    {
+        fmm_leaf_pairs(a, b, bodies);
+        return;
+    }
+
+    // big pairs split both sides, child k of a meeting child k + round of b, so each round can be tasks
+    if (!a->leaf && !b->leaf && a->count + b->count >= FMM_TASK_BODIES)
+    {
+        Chunk *children_a[8], *children_b[8];
+        fmm_children(a, children_a);
+        fmm_children(b, children_b);
+
+        for (int round = 0; round < 8; round++)
+        {
+            for (int k = 0; k < 8; k++)
+            {
+                Chunk *child_a = children_a[k], *child_b = children_b[(k + round) % 8];
+                if (child_a != NULL && child_b != NULL)
+                {
+                    OMP_PRAGMA(omp task if(child_a->count + child_b->count >= FMM_TASK_BODIES))
+                    fmm_interact(child_a, child_b, bodies);
+                }
+            }
+            OMP_PRAGMA(omp taskwait)
+        }
+
+        return;
+    }
+
+    // split whichever is larger, unless it is a leaf
+    bool split_a = !a->leaf && (b->leaf || radius_a >= radius_b);
+    Chunk *split = split_a ? a : b;
+    Chunk *other = split_a ? b : a;
+
+    for (int x = 0; x < 2; x++)
+        for (int y = 0; y < 2; y++)
+            for (int z = 0; z < 2; z++)
+            {
+                if (split->child[x][y][z] != NULL)
+                {
+                    fmm_interact(split->child[x][y][z], other, bodies);
+                }
+            }
+}
+
+// everything inside one chunk, its children with themselves and with each other
+void fmm_self(Chunk *chunk, Body_store *bodies)
+{
+    if (chunk->leaf)
+    {
+        fmm_leaf_pairs(chunk, chunk, bodies);
+        return;
+    }
+
+    Chunk *children[8];
+    fmm_children(chunk, children);
+
+    for (int k = 0; k < 8; k++)
+    {
+        if (children[k] != NULL)
+        {
+            OMP_PRAGMA(omp task if(children[k]->count >= FMM_TASK_BODIES))
+            fmm_self(children[k], bodies);
+        }
+    }
+    OMP_PRAGMA(omp taskwait)
+
+    // the 28 pairs of children in 7 rounds of 4, child 7 stays put while the others turn around it
+    for (int round = 0; round < 7; round++)
+    {
+        for (int k = 0; k < 4; k++)
+        {
+            Chunk *first = children[(k == 0) ? 7 : (round + k) % 7];
+            Chunk *second = children[(round + 7 - k) % 7];
+            if (first != NULL && second != NULL)
+            {
+                OMP_PRAGMA(omp task if(first->count + second->count >= FMM_TASK_BODIES))
+                fmm_interact(first, second, bodies);
+            }
+        }
+        OMP_PRAGMA(omp taskwait)
+    }
+}
+
+// pushes local expansions down to the children and finally to the bodies
+void fmm_downward(Chunk *chunk, Body_store *bodies)
+{
+    Octree *octree = &bodies->octree;
+    Fmm *fmm = &bodies->fmm;
+    int terms = fmm->terms;
+    double *local = &fmm->local[(size_t)(chunk - octree->pool) * terms];
+    Vec3 centre = chunk->centre_of_mass;
+    double powers[3][MAX_FMM_ORDER + 1];
+
+    if (chunk->leaf)
+    {
+        // the acceleration is the gradient of sum over beta of L_beta e^beta
+        for (int k = chunk->first; k < chunk->first + chunk->count; k++)
+        {
+            int i = octree->order[k];
+            Vec3 e = {bodies->position_x[i] - centre.x, bodies->position_y[i] - centre.y, bodies->position_z[i] - centre.z};
+            double gradient[3] = {0.0, 0.0, 0.0};
+
+            fmm_powers(e, fmm->order, powers);
+            for (int b = 1; b < terms; b++)
+            {
+                int *p = &fmm->power[3 * b];
+
+                if (p[0] > 0) gradient[0] += local[b] * p[0] * powers[0][p[0] - 1] * powers[1][p[1]] * powers[2][p[2]];
+                if (p[1] > 0) gradient[1] += local[b] * p[1] * powers[0][p[0]] * powers[1][p[1] - 1] * powers[2][p[2]];
+                if (p[2] > 0) gradient[2] += local[b] * p[2] * powers[0][p[0]] * powers[1][p[1]] * powers[2][p[2] - 1];
+            }
+
+            bodies->acceleration_x[i] += gradient[0];
+            bodies->acceleration_y[i] += gradient[1];
+            bodies->acceleration_z[i] += gradient[2];
+        }
+
+        return;
+    }
+
+    for (int x = 0; x < 2; x++)
+        for (int y = 0; y < 2; y++)
+            for (int z = 0; z < 2; z++)
+            {
+                Chunk *child = chunk->child[x][y][z];
+                if (child == NULL)
+                    continue;
+
+                // L'_gamma = sum over beta >= gamma of (beta choose gamma) s^(beta - gamma) L_beta
+                double *child_local = &fmm->local[(size_t)(child - octree->pool) * terms];
+                Vec3 s = {child->centre_of_mass.x - centre.x, child->centre_of_mass.y - centre.y, child->centre_of_mass.z - centre.z};
+
+                fmm_powers(s, fmm->order, powers);
+                for (int g = 0; g < terms; g++)
+                {
+                    int *pg = &fmm->power[3 * g];
+
+                    for (int b = g; b < terms; b++)
+                    {
+                        int *pb = &fmm->power[3 * b];
+                        if (pb[0] < pg[0] || pb[1] < pg[1] || pb[2] < pg[2])
+                            continue;
+
+                        child_local[g] += fmm->choose[pb[0]][pg[0]] * fmm->choose[pb[1]][pg[1]] * fmm->choose[pb[2]][pg[2]] *
+                                          powers[0][pb[0] - pg[0]] * powers[1][pb[1] - pg[1]] * powers[2][pb[2] - pg[2]] * local[b];
+                    }
+                }
+
+                OMP_PRAGMA(omp task if(child->count >= FMM_TASK_BODIES))
+                fmm_downward(child, bodies);
+            }
+    OMP_PRAGMA(omp taskwait)
+}
+
+/*
+    particle mesh
+
+    Spreads the mass of the massive bodies over a mesh_size^3 grid with cloud-in-cell weights,
+    solves for the potential by convolving with the Green's function of -1 / r using FFTs, and
+    interpolates the mesh accelerations back to every body with the same weights. The grid is
+    padded to twice its size with zeros so the FFT's periodic images never reach the bodies. The
+    cost is O(N + M^3 log M) but forces are smoothed over about a cell, so close pairs are too weak.
+*/
+// approximates the gravitational forces on all bodies from the potential on a mesh
+void apply_gravitational_forces_particle_mesh(Body_store *bodies)
+{
+    Mesh *mesh = &bodies->mesh;
+    int n = bodies->count;
+    int size = mesh_size;
+
+    init_mesh(bodies, size);
+
+    int padded = mesh->padded;
+    double *grid = mesh->grid;
+
+    // the grid covers every body, with the last row of nodes left free for the cloud-in-cell corners
+    Vec3 min, max;
+    min = max = (Vec3){bodies->position_x[0], bodies->position_y[0], bodies->position_z[0]};
+    for (int i = 0; i < n; i++)
+    {
+        min.x = fmin(min.x, bodies->position_x[i]); max.x = fmax(max.x, bodies->position_x[i]);
+        min.y = fmin(min.y, bodies->position_y[i]); max.y = fmax(max.y, bodies->position_y[i]);
+        min.z = fmin(min.z, bodies->position_z[i]); max.z = fmax(max.z, bodies->position_z[i]);
+    }
+
+    double extent = fmax(max.x - min.x, fmax(max.y - min.y, max.z - min.z));
+    double cell = (extent * 1.0001 + 1.0) / (size - 2);
+
+    memset(grid, 0, (size_t)2 * padded * padded * padded * sizeof(double));
+
+    for (int i = 0; i < bodies->massive_count; i++)
+    {
+        int node[3];
+        double weight[3][2];
+        mesh_weights(bodies, i, min, cell, node, weight);
+
+        for (int x = 0; x < 2; x++)
+            for (int y = 0; y < 2; y++)
+                for (int z = 0; z < 2; z++)
+                {
+                    size_t index = ((size_t)(node[0] + x) * padded + (node[1] + y)) * padded + (node[2] + z);
+                    grid[2 * index] += bodies->gm[i] * weight[0][x] * weight[1][y] * weight[2][z];
+                }
+    }
+
+    // convolution with the Green's function, whose transform is real
+    fft_mesh(bodies, false, size);
+
+    for (size_t index = 0; index < (size_t)padded * padded * padded; index++)
+    {
+        grid[2 * index] *= mesh->green[index];
+        grid[2 * index + 1] *= mesh->green[index];
+    }
+
+    fft_mesh(bodies, true, size);
+
+    // accelerations at the nodes from central differences of the potential, one sided at the edges
+    double scale = 1.0 / ((double)padded * padded * padded * cell); // inverse FFT normalisation and 1 / r in metres
+
+    OMP_PRAGMA(omp parallel for schedule(static) num_threads(thread_count))
+    for (int x = 0; x < size; x++)
+    {
+        for (int y = 0; y < size; y++)
+        {
+            for (int z = 0; z < size; z++)
+            {
+                int at[3] = {x, y, z};
+                size_t node = ((size_t)x * size + y) * size + z;
+
+                for (int d = 0; d < 3; d++)
+                {
+                    int below[3] = {x, y, z}, above[3] = {x, y, z};
+                    below[d] = (at[d] > 0) ? at[d] - 1 : at[d];
+                    above[d] = (at[d] < size - 1) ? at[d] + 1 : at[d];
+
+                    double potential_below = grid[2 * (((size_t)below[0] * padded + below[1]) * padded + below[2])];
+                    double potential_above = grid[2 * (((size_t)above[0] * padded + above[1]) * padded + above[2])];
+
+                    mesh->field[3 * node + d] = -(potential_above - potential_below) * scale / ((above[d] - below[d]) * cell);
+                }
+            }
+        }
+    }
+
+    OMP_PRAGMA(omp parallel for schedule(static) num_threads(pass_threads(n)))
+    for (int i = 0; i < n; i++)
+    {
+        int node[3];
+        double weight[3][2];
+        double acceleration[3] = {0.0, 0.0, 0.0};
+        mesh_weights(bodies, i, min, cell, node, weight);
+
+        for (int x = 0; x < 2; x++)
+            for (int y = 0; y < 2; y++)
+                for (int z = 0; z < 2; z++)
+                {
+                    size_t index = ((size_t)(node[0] + x) * size + (node[1] + y)) * size + (node[2] + z);
+                    double w = weight[0][x] * weight[1][y] * weight[2][z];
+
+                    acceleration[0] += w * mesh->field[3 * index];
+                    acceleration[1] += w * mesh->field[3 * index + 1];
+                    acceleration[2] += w * mesh->field[3 * index + 2];
+                }
+
+        bodies->acceleration_x[i] = acceleration[0];
+        bodies->acceleration_y[i] = acceleration[1];
+        bodies->acceleration_z[i] = acceleration[2];
+    }
+}
+
+// lower corner node of the cell holding a body and its cloud-in-cell weights for both nodes on each axis
+void mesh_weights(Body_store *bodies, int i, Vec3 origin, double cell, int node[3], double weight[3][2])
+{
+    Mesh *mesh = &bodies->mesh;
+    double u[3] = {
+        (bodies->position_x[i] - origin.x) / cell,
+        (bodies->position_y[i] - origin.y) / cell,
+        (bodies->position_z[i] - origin.z) / cell};
+
+    for (int d = 0; d < 3; d++)
+    {
+        node[d] = (int)u[d];
+        if (node[d] > mesh->size - 2)
+        {
+            node[d] = mesh->size - 2;
+        }
+
+        double fraction = u[d] - node[d];
+        weight[d][0] = 1.0 - fraction;
+        weight[d][1] = fraction;
+    }
+}
+
+// allocates the mesh and transforms the Green's function whenever the mesh size changes
+void init_mesh(Body_store *bodies, int size)
+{
+    Mesh *mesh = &bodies->mesh;
+
+    if (mesh->size == size)
+        return;
+
+    int padded = 2 * size;
+    size_t cells = (size_t)padded * padded * padded;
+
+    free(mesh->grid);
+    free(mesh->green);
+    free(mesh->field);
+    free(mesh->twiddle);
+
+    mesh->grid = malloc(2 * cells * sizeof(double));
+    mesh->green = malloc(cells * sizeof(double));
+    mesh->field = malloc((size_t)3 * size * size * size * sizeof(double));
+    mesh->twiddle = malloc(padded * sizeof(double));
+    if (!mesh->grid || !mesh->green || !mesh->field || !mesh->twiddle)
+    {
+        perror("malloc failed");
+        exit(EXIT_FAILURE);
+    }
+
+    mesh->size = size;
+    mesh->padded = padded;
+
+    for (int k = 0; k < padded / 2; k++)
+    {
+        mesh->twiddle[2 * k] = cos(-2.0 * M_PI * k / padded);
+        mesh->twiddle[2 * k + 1] = sin(-2.0 * M_PI * k / padded);
+    }
+
+    // -1 / r in cells, measured the short way round the padded grid, with the self cell set to -1
+    for (int x = 0; x < padded; x++)
+        for (int y = 0; y < padded; y++)
+            for (int z = 0; z < padded; z++)
+            {
+                int dx = (x <= size) ? x : padded - x;
+                int dy = (y <= size) ? y : padded - y;
+                int dz = (z <= size) ? z : padded - z;
+                double r = sqrt((double)(dx * dx + dy * dy + dz * dz));
+                size_t index = ((size_t)x * padded + y) * padded + z;
+
+                mesh->grid[2 * index] = (r > 0) ? -1.0 / r : -1.0;
+                mesh->grid[2 * index + 1] = 0.0;
+            }
+
+    // every line is transformed, the Green's function fills the whole padded grid
+    fft_mesh(bodies, false, padded);
+
+    for (size_t index = 0; index < cells; index++)
+    {
+        mesh->green[index] = mesh->grid[2 * index];
+    }
+}
+
+// 3D FFT of the padded grid. Only the first occupied planes on each axis hold mass going forward and only
+// they are read coming back, so transforms along z and y skip the lines outside them
+void fft_mesh(Body_store *bodies, bool inverse, int occupied)
+{
+    Mesh *mesh = &bodies->mesh;
+    int padded = mesh->padded;
+
+    for (int pass = 0; pass < 3; pass++)
+    {
+        // forward goes z, y then x, the inverse x, y then z
+        int axis = inverse ? pass : 2 - pass;
+
+        // a and b are the other two axes in x, y, z order
+        int lines_a = (axis == 0) ? padded : occupied;
+        int lines_b = (axis == 2) ? occupied : padded;
+
+        OMP_PRAGMA(omp parallel for schedule(static) num_threads(thread_count))
+        for (int a = 0; a < lines_a; a++)
+        {
+            double line[4 * MAX_MESH_SIZE];
+
+            for (int b = 0; b < lines_b; b++)
+            {
+                size_t start, stride;
+
+                if (axis == 2)
+                {
+                    start = ((size_t)a * padded + b) * padded;
+                    stride = 1;
+                }
+                else if (axis == 1)
+                {
+                    start = (size_t)a * padded * padded + b;
+                    stride = padded;
+                }
+                else
+                {
+                    start = (size_t)a * padded + b;
+                    stride = (size_t)padded * padded;
+                }
+
+                for (int k = 0; k < padded; k++)
+                {
+                    line[2 * k] = mesh->grid[2 * (start + k * stride)];
+                    line[2 * k + 1] = mesh->grid[2 * (start + k * stride) + 1];
+                }
+
+                fft(line, padded, mesh->twiddle, inverse);
+
+                for (int k = 0; k < padded; k++)
+                {
+                    mesh->grid[2 * (start + k * stride)] = line[2 * k];
+                    mesh->grid[2 * (start + k * stride) + 1] = line[2 * k + 1];
+                }
+            }
+        }
+    }
+}
+
+// in place radix-2 FFT of n complex numbers stored as real, imaginary pairs, unnormalised both ways.
+// twiddle holds cos and sin of -2 pi k / n for k < n / 2
+void fft(double *data, int n, double *twiddle, bool inverse)
+{
+    for (int i = 1, j = 0; i < n; i++)
+    {
+        int bit = n >> 1;
+        for (; j & bit; bit >>= 1)
+        {
+            j ^= bit;
+        }
+        j ^= bit;
+
+        if (i < j)
+        {
+            double swap_re = data[2 * i], swap_im = data[2 * i + 1];
+            data[2 * i] = data[2 * j];
+            data[2 * i + 1] = data[2 * j + 1];
+            data[2 * j] = swap_re;
+            data[2 * j + 1] = swap_im;
+        }
+    }
+
+    for (int length = 2; length <= n; length <<= 1)
+    {
+        int step = n / length;
+
+        for (int k = 0; k < length / 2; k++)
+        {
+            double w_re = twiddle[2 * k * step];
+            double w_im = inverse ? -twiddle[2 * k * step + 1] : twiddle[2 * k * step + 1];
+
+            for (int start = 0; start < n; start += length)
+            {
+                int a = start + k;
+                int b = a + length / 2;
+
+                double t_re = data[2 * b] * w_re - data[2 * b + 1] * w_im;
+                double t_im = data[2 * b] * w_im + data[2 * b + 1] * w_re;
+
+                data[2 * b] = data[2 * a] - t_re;
+                data[2 * b + 1] = data[2 * a + 1] - t_im;
+                data[2 * a] += t_re;
+                data[2 * a + 1] += t_im;
+            }
+        }
+    }
+}
+
+/*
+    state updates
+*/
+// updates the velocity and position of a given body
+void update(Body_store *bodies, int i, double dt)
+{
+    if (bodies->encke.mode && bodies->encke.mode[i] == PROPAGATE_ENCKE)
+    {
+        update_encke(bodies, i, dt);
+        return;
+    }
+
+    bodies->velocity_x[i] += bodies->acceleration_x[i] * dt;
+    bodies->velocity_y[i] += bodies->acceleration_y[i] * dt;
+    bodies->velocity_z[i] += bodies->acceleration_z[i] * dt;
+
+    bodies->position_x[i] += bodies->velocity_x[i] * dt;
+    bodies->position_y[i] += bodies->velocity_y[i] * dt;
+    bodies->position_z[i] += bodies->velocity_z[i] * dt;
+}
+
+// updates the velocity and position of all bodies
+void update_N(Body_store *bodies, double dt)
+{
+    bool encke = (bodies->encke.mode && bodies->encke.no_encke > 0);
+    double centre[6];
+
+    if (encke)
+        centre_of_mass(bodies, centre);
+
+    for (int i = 0; i < bodies->count; i++)
+    {
+        update(bodies, i, dt);
+    }
+
+    if (encke)
+        recentre_encke(bodies, centre, dt);
+}
+
+// changes every velocity by its acceleration over dt
+void kick(Body_store *bodies, double dt)
+{
+    for (int i = 0; i < bodies->count; i++)
+    {
+        bodies->velocity_x[i] += bodies->acceleration_x[i] * dt;
+        bodies->velocity_y[i] += bodies->acceleration_y[i] * dt;
+        bodies->velocity_z[i] += bodies->acceleration_z[i] * dt;
+    }
+}
+
+// moves every position by its velocity over dt
+void drift(Body_store *bodies, double dt)
+{
+    for (int i = 0; i < bodies->count; i++)
+    {
+        bodies->position_x[i] += bodies->velocity_x[i] * dt;
+        bodies->position_y[i] += bodies->velocity_y[i] * dt;
+        bodies->position_z[i] += bodies->velocity_z[i] * dt;
+    }
+}
+
+/*
+    integrators
+
+    The fixed step integrators expect the accelerations to match the positions when a step
+    starts and leave them matching when it ends (apart from Forest-Ruth, which ends on a drift),
+    so every force pass is used by the next step as well.
+*/
+// works out the starting accelerations
+void start_fixed_step(Body_store *bodies)
+{
+    apply_gravitational_forces_N(bodies);
+}
+
+// moves the bodies from one time to another in delta_time steps, shortening the last one to land exactly
+void advance_fixed_steps(void (*step)(Body_store *, double), Body_store *bodies, double from, double to)
+{
+    double time = from;
+
+    while (time < to)
+    {
+        double dt = fmin(delta_time, to - time);
+
+        step(bodies, dt);
+        time += dt;
+    }
+}
+
+// first force pass, then the bodies that get Encke propagation
+void start_euler(Body_store *bodies)
+{
+    start_fixed_step(bodies);
+    init_encke(bodies);
+}
+
+// first order semi-implicit Euler, the original update
+void euler_step(Body_store *bodies, double dt)
+{
+    update_N(bodies, dt);
+    apply_gravitational_forces_N(bodies);
+}
+
+// second order kick-drift-kick leapfrog, one force pass per step
+void leapfrog_step(Body_store *bodies, double dt)
+{
+    if (force_engine == DIRECT && small_kernel_fits(bodies))
+    {
+        force_passes++;
+        small_leapfrog_kernels[bodies->count](bodies, dt);
+        return;
+    }
+
+    kick(bodies, dt / 2);
+    drift(bodies, dt);
+    apply_gravitational_forces_N(bodies);
+    kick(bodies, dt / 2);
+}
+
+// fourth order Yoshida triple jump, three leapfrog steps with one of them backwards
+void yoshida_step(Body_store *bodies, double dt)
+{
+    double cube_root = cbrt(2.0);
+    double w1 = 1.0 / (2.0 - cube_root);
+    double w0 = -cube_root / (2.0 - cube_root);
+
+    leapfrog_step(bodies, w1 * dt);
+    leapfrog_step(bodies, w0 * dt);
+    leapfrog_step(bodies, w1 * dt);
+}
+
+// fourth order Forest-Ruth, the same triple jump built from drift-kick-drift steps
+void forest_ruth_step(Body_store *bodies, double dt)
+{
+    double theta = 1.0 / (2.0 - cbrt(2.0));
+
+    drift(bodies, theta * dt / 2);
+    apply_gravitational_forces_N(bodies);
+    kick(bodies, theta * dt);
+    drift(bodies, (1.0 - theta) * dt / 2);
+    apply_gravitational_forces_N(bodies);
+    kick(bodies, (1.0 - 2.0 * theta) * dt);
+    drift(bodies, (1.0 - theta) * dt / 2);
+    apply_gravitational_forces_N(bodies);
+    kick(bodies, theta * dt);
+    drift(bodies, theta * dt / 2);
+}
+
+// hermite block steps finish every block that ends in time, then predict the rest of the way
+bool advance_hermite(Body_store *bodies, double from, double to)
+{
+    // the blocks keep their own time, so where the last call stopped is not needed
+    (void)from;
+    while (next_block_time(bodies) * bodies->blocks.tick <= to)
+    {
+        hermite_step(bodies);
+    }
+
+    hermite_predict(bodies, to);
+    return true;
+}
+
+/*
+    gauss-radau
+
+    Adaptive 15th order integrator in the style of IAS15 (Rein & Spiegel 2015). Over a step the
+    acceleration of every component is a degree 7 polynomial in the step fraction h,
+    a(h) = a0 + b1 h + ... + b7 h^7, fitted to force passes at the 7 Gauss-Radau spacings
+    by predictor-corrector iteration. The size of b7 estimates the error and picks the next step.
+*/
+const double RADAU_SPACINGS[8] = {
+    0.0,
+    0.0562625605369221464656521910318,
+    0.180240691736892364987579942780,
+    0.352624717113169637373907769648,
+    0.547153626330555383001448554766,
+    0.734210177215410531523210605558,
+    0.885320946839095768090359771030,
+    0.977520613561287501891174488626};
+
+// coefficient of h^m in h (h - h1) ... (h - h[k-1]), converting the divided differences g to b
+double radau_newton[8][8];
+
+// allocates the gauss-radau state and works out the starting accelerations
+void start_radau(Body_store *bodies)
+{
+    Radau_state *radau = &bodies->radau;
+    int components = 3 * bodies->count;
+
+    // product polynomials of the spacings, built once
+    if (radau_newton[1][1] == 0.0)
+    {
+        radau_newton[0][0] = 1.0;
+        for (int k = 1; k < 8; k++)
+        {
+            for (int m = 0; m <= k; m++)
+            {
+                double lower = (m > 0) ? radau_newton[k - 1][m - 1] : 0.0;
+                radau_newton[k][m] = lower - RADAU_SPACINGS[k - 1] * radau_newton[k - 1][m];
+            }
+        }
+    }
+
+    if (radau->components != components)
+    {
+        free(radau->block);
+        radau->block = malloc((size_t)RADAU_ARRAYS * components * sizeof(double));
+        if (!radau->block)
+        {
+            perror("malloc failed");
+            exit(EXIT_FAILURE);
+        }
+
+        double *next = radau->block;
+        radau->x0 = next; next += components;
+        radau->v0 = next; next += components;
+        radau->a0 = next; next += components;
+        radau->x1 = next; next += components;
+        radau->v1 = next; next += components;
+        radau->a1 = next; next += components;
+        radau->compensation_x = next; next += components;
+        radau->compensation_v = next; next += components;
+        for (int k = 0; k < 7; k++)
+        {
+            radau->g[k] = next; next += components;
+            radau->b[k] = next; next += components;
+            radau->dense[k] = next; next += components;
+        }
+
+        radau->components = components;
+    }
+
+    memset(radau->block, 0, (size_t)RADAU_ARRAYS * components * sizeof(double));
+    radau->step = delta_time;
+    radau->time = 0.0;
+    radau->last_step = 0.0;
+
+    start_fixed_step(bodies);
+}
+
+// one attempt at a step of dt seconds, returns false and leaves the bodies untouched if the error is too big
+bool radau_step(Body_store *bodies, double dt, double *next_step)
+{
+    Radau_state *radau = &bodies->radau;
+    int n = bodies->count;
+    int components = 3 * n;
+    double *position[3] = {bodies->position_x, bodies->position_y, bodies->position_z};
+    double *velocity[3] = {bodies->velocity_x, bodies->velocity_y, bodies->velocity_z};
+    double *acceleration[3] = {bodies->acceleration_x, bodies->acceleration_y, bodies->acceleration_z};
+
+    for (int i = 0; i < n; i++)
+    {
+        for (int d = 0; d < 3; d++)
+        {
+            radau->x0[3 * i + d] = position[d][i];
+            radau->v0[3 * i + d] = velocity[d][i];
+            radau->a0[3 * i + d] = acceleration[d][i];
+        }
+    }
+
+    // the step is worked out around the centre of mass, where a position is not rounded to the
+    // size of its distance from the origin, which would stop b7 from getting any smaller
+    double centre[3] = {0.0, 0.0, 0.0};
+    double total_mass = 0.0;
+    for (int i = 0; i < n; i++)
+    {
+        total_mass += bodies->mass[i];
+        for (int d = 0; d < 3; d++)
+        {
+            centre[d] += bodies->mass[i] * position[d][i];
+        }
+    }
+    for (int d = 0; d < 3; d++)
+    {
+        centre[d] = (total_mass > 0.0) ? centre[d] / total_mass : 0.0;
+    }
+
+    // divided differences that match the predicted b
+    for (int c = 0; c < components; c++)
+    {
+        for (int k = 7; k >= 1; k--)
+        {
+            double g = radau->b[k - 1][c];
+            for (int higher = k + 1; higher <= 7; higher++)
+            {
+                g -= radau->g[higher - 1][c] * radau_newton[higher][k];
+            }
+            radau->g[k - 1][c] = g;
+        }
+    }
+
+    double largest_acceleration = 0.0;
+
+    for (int iteration = 0; iteration < RADAU_MAX_ITERATIONS; iteration++)
+    {
+        double largest_change = 0.0;
+        largest_acceleration = 0.0;
+
+        for (int k = 1; k < 8; k++)
+        {
+            double h = RADAU_SPACINGS[k];
+
+            // positions at this spacing from the current polynomial
+            for (int i = 0; i < n; i++)
+            {
+                for (int d = 0; d < 3; d++)
+                {
+                    int c = 3 * i + d;
+                    double sum = radau->a0[c] / 2.0;
+                    double power = h;
+                    for (int m = 1; m <= 7; m++)
+                    {
+                        sum += radau->b[m - 1][c] * power / ((m + 1) * (m + 2));
+                        power *= h;
+                    }
+                    double start = radau->x0[c] - centre[d] - radau->compensation_x[c];
+                    position[d][i] = start + dt * h * radau->v0[c] + dt * dt * h * h * sum;
+                }
+            }
+
+            apply_gravitational_forces_N(bodies);
+
+            // new divided difference at this spacing, and the b coefficients it touches
+            for (int i = 0; i < n; i++)
+            {
+                for (int d = 0; d < 3; d++)
+                {
+                    int c = 3 * i + d;
+                    double g = (acceleration[d][i] - radau->a0[c]) / h;
+                    for (int j = 1; j < k; j++)
+                    {
+                        g = (g - radau->g[j - 1][c]) / (h - RADAU_SPACINGS[j]);
+                    }
+
+                    double change = g - radau->g[k - 1][c];
+                    radau->g[k - 1][c] = g;
+                    for (int m = 1; m <= k; m++)
+                    {
+                        radau->b[m - 1][c] += change * radau_newton[k][m];
+                    }
+
+                    if (k == 7)
+                    {
+                        largest_change = fmax(largest_change, fabs(change));
+                        largest_acceleration = fmax(largest_acceleration, fabs(acceleration[d][i]));
+                    }
+                }
+            }
+        }
+
+        if (largest_acceleration == 0.0 || largest_change / largest_acceleration < RADAU_CONVERGENCE)
+            break;
+    }
+
+    // error estimate from the highest coefficient
+    double largest_b7 = 0.0;
+    for (int c = 0; c < components; c++)
+    {
+        largest_b7 = fmax(largest_b7, fabs(radau->b[6][c]));
+    }
+
+    double error = (largest_acceleration > 0.0) ? largest_b7 / largest_acceleration : 0.0;
+    double new_step = (error > 0.0) ? dt * pow(radau_accuracy / error, 1.0 / 7.0) : dt / RADAU_SAFETY;
+    double ratio = new_step / dt;
+
+    if (ratio < RADAU_SAFETY)
+    {
+        // rejected, put everything back and shrink the polynomial guess to the shorter step
+        for (int i = 0; i < n; i++)
+        {
+            for (int d = 0; d < 3; d++)
+            {
+                position[d][i] = radau->x0[3 * i + d];
+                acceleration[d][i] = radau->a0[3 * i + d];
+            }
+        }
+
+        for (int c = 0; c < components; c++)
+        {
+            double q = ratio;
+            for (int m = 1; m <= 7; m++)
+            {
+                radau->b[m - 1][c] *= q;
+                q *= ratio;
+            }
+        }
+
+        *next_step = new_step;
+        return false;
+    }
+
+    // accepted, position and velocity at the end of the step with compensated sums
+    for (int i = 0; i < n; i++)
+    {
+        for (int d = 0; d < 3; d++)
+        {
+            int c = 3 * i + d;
+            double position_sum = radau->a0[c] / 2.0;
+            double velocity_sum = radau->a0[c];
+            for (int m = 1; m <= 7; m++)
+            {
+                position_sum += radau->b[m - 1][c] / ((m + 1) * (m + 2));
+                velocity_sum += radau->b[m - 1][c] / (m + 1);
+            }
+
+            // the end forces are found around the centre too, so the next step starts from them
+            double start = radau->x0[c] - centre[d] - radau->compensation_x[c];
+            position[d][i] = start + dt * radau->v0[c] + dt * dt * position_sum;
+
+            double change = dt * velocity_sum - radau->compensation_v[c];
+            double total = radau->v0[c] + change;
+            radau->compensation_v[c] = (total - radau->v0[c]) - change;
+            velocity[d][i] = total;
+        }
+    }
+
+    apply_gravitational_forces_N(bodies);
+
+    // back from the centre, keeping what rounding to the distance from the origin loses
+    for (int i = 0; i < n; i++)
+    {
+        for (int d = 0; d < 3; d++)
+        {
+            int c = 3 * i + d;
+            double relative = position[d][i];
+            position[d][i] = centre[d] + relative;
+            radau->compensation_x[c] = (position[d][i] - centre[d]) - relative;
+        }
+    }
+
+    for (int m = 0; m < 7; m++)
+    {
+        memcpy(radau->dense[m], radau->b[m], components * sizeof(double));
+    }
+
+    // at most RADAU_SAFETY times longer, then the polynomial is shifted onto the next step as its first guess
+    if (ratio > 1.0 / RADAU_SAFETY)
+    {
+        ratio = 1.0 / RADAU_SAFETY;
+        new_step = dt * ratio;
+    }
+
+    for (int c = 0; c < components; c++)
+    {
+        double old_b[8];
+        for (int m = 1; m <= 7; m++)
+        {
+            old_b[m] = radau->b[m - 1][c];
+        }
+
+        double q = ratio;
+        for (int m = 1; m <= 7; m++)
+        {
+            // b'm = q^m * sum over n >= m of (n choose m) bn
+            double sum = 0.0;
+            double choose = 1.0;
+            for (int k = m; k <= 7; k++)
+            {
+                sum += choose * old_b[k];
+                choose = choose * (k + 1) / (k + 1 - m);
+            }
+            radau->b[m - 1][c] = q * sum;
+            q *= ratio;
+        }
+    }
+
+    *next_step = new_step;
+    return true;
+}
+
+// takes adaptive steps as long as the error allows, running past the log time instead of cutting the last
+// step short, then sets the bodies to the log time from the acceleration polynomial of the step it fell in.
+// The state at the end of that step is kept aside and carried on from next time. Returns false if the
+// accuracy could not be kept even at RADAU_MIN_STEP
+bool advance_radau(Body_store *bodies, double from, double to)
+{
+    Radau_state *radau = &bodies->radau;
+    int n = bodies->count;
+    double *position[3] = {bodies->position_x, bodies->position_y, bodies->position_z};
+    double *velocity[3] = {bodies->velocity_x, bodies->velocity_y, bodies->velocity_z};
+    double *acceleration[3] = {bodies->acceleration_x, bodies->acceleration_y, bodies->acceleration_z};
+
+    // the bodies were set to the last log time, go back to where the steps got to
+    if (radau->time > from)
+    {
+        for (int i = 0; i < n; i++)
+        {
+            for (int d = 0; d < 3; d++)
+            {
+                position[d][i] = radau->x1[3 * i + d];
+                velocity[d][i] = radau->v1[3 * i + d];
+                acceleration[d][i] = radau->a1[3 * i + d];
+            }
+        }
+    }
+
+    int floor_steps = 0;
+    while (radau->time < to)
+    {
+        double dt = radau->step;
+        double next_step;
+
+        if (radau_step(bodies, dt, &next_step))
+        {
+            radau->time += dt;
+            radau->last_step = dt;
+        }
+        radau->step = fmax(next_step, RADAU_MIN_STEP);
+
+        // an error that stays too big however short the steps get is a limit of the arithmetic, not of the step
+        floor_steps = (dt > RADAU_MIN_STEP) ? 0 : floor_steps + 1;
+        if (floor_steps >= RADAU_MAX_FLOOR_STEPS)
+        {
+            fprintf(stderr, "Gauss-Radau could not keep to an accuracy of %.1e even with %.0e second steps\n", radau_accuracy, RADAU_MIN_STEP);
+            return false;
+        }
+    }
+
+    if (radau->time == to)
+        return true;
+
+    // dense output at the fraction of the last step the log time is at
+    double dt = radau->last_step;
+    double h = (to - (radau->time - dt)) / dt;
+
+    for (int i = 0; i < n; i++)
+    {
+        for (int d = 0; d < 3; d++)
+        {
+            int c = 3 * i + d;
+            radau->x1[c] = position[d][i];
+            radau->v1[c] = velocity[d][i];
+            radau->a1[c] = acceleration[d][i];
+
+            double position_sum = radau->a0[c] / 2.0;
+            double velocity_sum = radau->a0[c];
+            double acceleration_sum = radau->a0[c];
+            double power = h;
+            for (int m = 1; m <= 7; m++)
+            {
+                position_sum += radau->dense[m - 1][c] * power / ((m + 1) * (m + 2));
+                velocity_sum += radau->dense[m - 1][c] * power / (m + 1);
+                acceleration_sum += radau->dense[m - 1][c] * power;
+                power *= h;
+            }
+
+            position[d][i] = radau->x0[c] + dt * h * radau->v0[c] + dt * dt * h * h * position_sum;
+            velocity[d][i] = radau->v0[c] + dt * h * velocity_sum;
+            acceleration[d][i] = acceleration_sum;
+        }
+    }
+
+    return true;
+}
+
+/*
+    wisdom-holman
+
+    Symplectic map for systems dominated by one central body, body 0 in every scenario. In
+    democratic heliocentric coordinates (Duncan, Levison & Lee 1998) the motion splits into a
+    Kepler orbit of every body around the central body, solved exactly, the pulls between the
+    other bodies, applied as kicks, and a drift of all bodies by the central body's momentum.
+    Errors scale with the perturbations instead of the central pull, so steps can be hours long.
+*/
+// allocates the saved interaction kicks and works out the first ones
+void start_wisdom_holman(Body_store *bodies)
+{
+    Wisdom_holman_state *state = &bodies->wisdom_holman;
+    int n = bodies->count;
+
+    if (state->count != n)
+    {
+        double **arrays[] = {&state->kick_x, &state->kick_y, &state->kick_z};
+
+        for (int i = 0; i < 3; i++)
+        {
+            free(*arrays[i]);
+            *arrays[i] = malloc(n * sizeof(double));
+            if (!*arrays[i])
+            {
+                perror("malloc failed");
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        state->count = n;
+    }
+
+    interaction_forces(bodies);
+}
+
+// pulls between everything except the central body, saved as kicks, then the central pull is added
+// back so the body store holds the full accelerations like every other integrator
+void interaction_forces(Body_store *bodies)
+{
+    Wisdom_holman_state *state = &bodies->wisdom_holman;
+    double central_mass = bodies->mass[0];
+    double central_gm = bodies->gm[0];
+
+    // a massless central body lets any force solver do the work
+    bodies->mass[0] = 0.0;
+    bodies->gm[0] = 0.0;
+    apply_gravitational_forces_N(bodies);
+    bodies->mass[0] = central_mass;
+    bodies->gm[0] = central_gm;
+
+    memcpy(state->kick_x, bodies->acceleration_x, bodies->count * sizeof(double));
+    memcpy(state->kick_y, bodies->acceleration_y, bodies->count * sizeof(double));
+    memcpy(state->kick_z, bodies->acceleration_z, bodies->count * sizeof(double));
+
+    for (int i = 1; i < bodies->count; i++)
+    {
+        double rx = bodies->position_x[0] - bodies->position_x[i];
+        double ry = bodies->position_y[0] - bodies->position_y[i];
+        double rz = bodies->position_z[0] - bodies->position_z[i];
+        double distance_squared = rx * rx + ry * ry + rz * rz;
+        double scale = central_gm / (distance_squared * sqrt(distance_squared));
+
+        bodies->acceleration_x[i] += scale * rx;
+        bodies->acceleration_y[i] += scale * ry;
+        bodies->acceleration_z[i] += scale * rz;
+    }
+}
+
+// Stumpff functions c2 and c3 of z = alpha * chi^2, with series near 0 where the closed forms cancel
+void stumpff(double z, double *c2, double *c3)
+{
+    if (fabs(z) < 0.1)
+    {
+        *c2 = 1.0 / 2 - z * (1.0 / 24 - z * (1.0 / 720 - z * (1.0 / 40320 - z * (1.0 / 3628800 - z / 479001600.0))));
+        *c3 = 1.0 / 6 - z * (1.0 / 120 - z * (1.0 / 5040 - z * (1.0 / 362880 - z * (1.0 / 39916800 - z / 6227020800.0))));
+    }
+    else if (z > 0)
+    {
+        double root = sqrt(z);
+        *c2 = (1 - cos(root)) / z;
+        *c3 = (root - sin(root)) / (z * root);
+    }
+    else
+    {
+        double root = sqrt(-z);
+        *c2 = (cosh(root) - 1) / -z;
+        *c3 = (sinh(root) - root) / (-z * root);
+    }
+}
+
+// moves one body along its two body orbit around mu for dt seconds, solving for the universal anomaly
+// with Laguerre-Conway iteration, which converges for elliptic and hyperbolic orbits alike
+void kepler_drift(double mu, double position[3], double velocity[3], double dt)
+{
+    double r0 = sqrt(position[0] * position[0] + position[1] * position[1] + position[2] * position[2]);
+    double v2 = velocity[0] * velocity[0] + velocity[1] * velocity[1] + velocity[2] * velocity[2];
+    double root_mu = sqrt(mu);
+    double sigma = (position[0] * velocity[0] + position[1] * velocity[1] + position[2] * velocity[2]) / root_mu;
+    double alpha = 2.0 / r0 - v2 / mu; // 1 / semi-major axis
+
+    double chi = (alpha > 0) ? root_mu * alpha * dt : root_mu * dt / r0;
+    double c2, c3, z;
+
+    for (int iteration = 0; iteration < KEPLER_MAX_ITERATIONS; iteration++)
+    {
+        z = alpha * chi * chi;
+        stumpff(z, &c2, &c3);
+
+        double chi2 = chi * chi;
+        double f = sigma * chi2 * c2 + (1 - alpha * r0) * chi2 * chi * c3 + r0 * chi - root_mu * dt;
+        double df = sigma * chi * (1 - z * c3) + (1 - alpha * r0) * chi2 * c2 + r0;
+        double ddf = sigma * (1 - z * c2) + (1 - alpha * r0) * chi * (1 - z * c3);
+
+        double discriminant = fabs(16 * df * df - 20 * f * ddf);
+        double change = 5 * f / (df + copysign(sqrt(discriminant), df));
+        chi -= change;
+
+        if (fabs(change) <= 1e-15 * fabs(chi))
+            break;
+    }
+
+    z = alpha * chi * chi;
+    stumpff(z, &c2, &c3);
+
+    double chi2 = chi * chi;
+    double r = chi2 * c2 + sigma * chi * (1 - z * c3) + r0 * (1 - z * c2);
+
+    // Lagrange coefficients
+    double f = 1 - chi2 * c2 / r0;
+    double g = dt - chi2 * chi * c3 / root_mu;
+    double df = root_mu * chi * (z * c3 - 1) / (r * r0);
+    double dg = 1 - chi2 * c2 / r;
+
+    for (int d = 0; d < 3; d++)
+    {
+        double p = position[d];
+        double v = velocity[d];
+        position[d] = f * p + g * v;
+        velocity[d] = df * p + dg * v;
+    }
+}
+
+// kicks every body but the central one with the saved interaction accelerations
+void interaction_kick(Body_store *bodies, double dt)
+{
+    Wisdom_holman_state *state = &bodies->wisdom_holman;
+
+    for (int i = 1; i < bodies->count; i++)
+    {
+        bodies->velocity_x[i] += state->kick_x[i] * dt;
+        bodies->velocity_y[i] += state->kick_y[i] * dt;
+        bodies->velocity_z[i] += state->kick_z[i] * dt;
+    }
+}
+
+// moves every body but the central one by the momentum they give the central body
+void central_jump(Body_store *bodies, double dt)
+{
+    double momentum_x = 0.0, momentum_y = 0.0, momentum_z = 0.0;
+
+    for (int i = 1; i < bodies->count; i++)
+    {
+        momentum_x += bodies->gm[i] * bodies->velocity_x[i];
+        momentum_y += bodies->gm[i] * bodies->velocity_y[i];
+        momentum_z += bodies->gm[i] * bodies->velocity_z[i];
+    }
+
+    double scale = dt / bodies->gm[0];
+
+    for (int i = 1; i < bodies->count; i++)
+    {
+        bodies->position_x[i] += momentum_x * scale;
+        bodies->position_y[i] += momentum_y * scale;
+        bodies->position_z[i] += momentum_z * scale;
+    }
+}
+
+// moves every body but the central one along its Kepler orbit around the central body
+void kepler_drifts(Body_store *bodies, double dt)
+{
+    OMP_PRAGMA(omp parallel for schedule(static) num_threads(pass_threads(bodies->count)))
+    for (int i = 1; i < bodies->count; i++)
+    {
+        double position[3] = {bodies->position_x[i], bodies->position_y[i], bodies->position_z[i]};
+        double velocity[3] = {bodies->velocity_x[i], bodies->velocity_y[i], bodies->velocity_z[i]};
+
+        kepler_drift(bodies->gm[0], position, velocity, dt);
+
+        bodies->position_x[i] = position[0]; bodies->position_y[i] = position[1]; bodies->position_z[i] = position[2];
+        bodies->velocity_x[i] = velocity[0]; bodies->velocity_y[i] = velocity[1]; bodies->velocity_z[i] = velocity[2];
+    }
+}
+
+// one kick, jump, Kepler, jump, kick step. The body store holds heliocentric positions and
+// barycentric velocities during the step and the inertial state again at the end
+void wisdom_holman_step(Body_store *bodies, double dt)
+{
+    int n = bodies->count;
+    double *position[3] = {bodies->position_x, bodies->position_y, bodies->position_z};
+    double *velocity[3] = {bodies->velocity_x, bodies->velocity_y, bodies->velocity_z};
+    double centre_of_mass[3] = {0.0, 0.0, 0.0};
+    double centre_velocity[3] = {0.0, 0.0, 0.0};
+    double total_gm = 0.0;
+
+    for (int i = 0; i < n; i++)
+    {
+        total_gm += bodies->gm[i];
+    }
+
+    for (int d = 0; d < 3; d++)
+    {
+        for (int i = 0; i < n; i++)
+        {
+            centre_of_mass[d] += bodies->gm[i] * position[d][i];
+            centre_velocity[d] += bodies->gm[i] * velocity[d][i];
+        }
+        centre_of_mass[d] /= total_gm;
+        centre_velocity[d] /= total_gm;
+
+        double central = position[d][0];
+        for (int i = 0; i < n; i++)
+        {
+            position[d][i] -= central;
+            velocity[d][i] -= centre_velocity[d];
+        }
+    }
+
+    interaction_kick(bodies, dt / 2);
+    central_jump(bodies, dt / 2);
+    kepler_drifts(bodies, dt);
+    central_jump(bodies, dt / 2);
+    interaction_forces(bodies);
+    interaction_kick(bodies, dt / 2);
+
+    // back to the inertial frame, the centre of mass coasts
+    for (int d = 0; d < 3; d++)
+    {
+        double offset = 0.0, momentum = 0.0;
+        for (int i = 1; i < n; i++)
+        {
+            offset += bodies->gm[i] * position[d][i];
+            momentum += bodies->gm[i] * velocity[d][i];
+        }
+
+        double central = centre_of_mass[d] + centre_velocity[d] * dt - offset / total_gm;
+
+        position[d][0] = central;
+        velocity[d][0] = centre_velocity[d] - momentum / bodies->gm[0];
+        for (int i = 1; i < n; i++)
+        {
+            position[d][i] += central;
+            velocity[d][i] += centre_velocity[d];
+        }
+    }
+}
+
+/*
+    encke
+
+    Per body propagation mode for the Euler integrator. A near-Keplerian body follows a reference
+    conic around body 0 that is solved exactly with kepler_drift, and Euler only integrates the
+    small deviation from it. The deviation's acceleration is a perturbation instead of the full
+    central pull, so much longer steps keep the same accuracy. When the deviation grows too large
+    the conic is rectified to the body's current orbit.
+*/
+// picks the bodies whose orbits around body 0 are barely perturbed and starts their reference conics
+void init_encke(Body_store *bodies)
+{
+    Encke_state *encke = &bodies->encke;
+    int n = bodies->count;
+
+    if (encke->count != n)
+    {
+        free(encke->mode);
+        free(encke->reference);
+        free(encke->deviation);
+        free(encke->elapsed);
+
+        encke->mode = malloc(n * sizeof(int));
+        encke->reference = malloc(6 * n * sizeof(double));
+        encke->deviation = malloc(6 * n * sizeof(double));
+        encke->elapsed = malloc(n * sizeof(double));
+        if (!encke->mode || !encke->reference || !encke->deviation || !encke->elapsed)
+        {
+            perror("malloc failed");
+            exit(EXIT_FAILURE);
+        }
+
+        encke->count = n;
+    }
+
+    encke->rectifications = 0;
+    encke->no_encke = 0;
+    encke->mode[0] = PROPAGATE_DIRECT;
+
+    for (int i = 1; i < n; i++)
+    {
+        encke->mode[i] = PROPAGATE_DIRECT;
+
+        if (encke_threshold <= 0 || bodies->gm[0] <= 0)
+            continue;
+
+        double r[3] = {
+            bodies->position_x[i] - bodies->position_x[0],
+            bodies->position_y[i] - bodies->position_y[0],
+            bodies->position_z[i] - bodies->position_z[0]};
+        double distance_squared = r[0] * r[0] + r[1] * r[1] + r[2] * r[2];
+        double mu = bodies->gm[0] + bodies->gm[i];
+        double scale = mu / (distance_squared * sqrt(distance_squared));
+
+        // whatever is left of the acceleration relative to body 0 once the two body pull is taken away
+        double perturbation[3] = {
+            bodies->acceleration_x[i] - bodies->acceleration_x[0] + scale * r[0],
+            bodies->acceleration_y[i] - bodies->acceleration_y[0] + scale * r[1],
+            bodies->acceleration_z[i] - bodies->acceleration_z[0] + scale * r[2]};
+        double size = sqrt(perturbation[0] * perturbation[0] + perturbation[1] * perturbation[1] + perturbation[2] * perturbation[2]);
+
+        if (size < encke_threshold * mu / distance_squared)
+        {
+            encke->mode[i] = PROPAGATE_ENCKE;
+            encke->no_encke++;
+            rectify(bodies, i);
+        }
+    }
+}
+
+// starts a new reference conic at the body's current position and velocity relative to body 0
+void rectify(Body_store *bodies, int i)
+{
+    Encke_state *encke = &bodies->encke;
+    double *reference = &encke->reference[6 * i];
+
+    reference[0] = bodies->position_x[i] - bodies->position_x[0];
+    reference[1] = bodies->position_y[i] - bodies->position_y[0];
+    reference[2] = bodies->position_z[i] - bodies->position_z[0];
+    reference[3] = bodies->velocity_x[i] - bodies->velocity_x[0];
+    reference[4] = bodies->velocity_y[i] - bodies->velocity_y[0];
+    reference[5] = bodies->velocity_z[i] - bodies->velocity_z[0];
+
+    memset(&encke->deviation[6 * i], 0, 6 * sizeof(double));
+    encke->elapsed[i] = 0.0;
+}
+
+// position and velocity of the centre of mass
+void centre_of_mass(Body_store *bodies, double centre[6])
+{
+    double total_gm = 0.0;
+    memset(centre, 0, 6 * sizeof(double));
+
+    for (int i = 0; i < bodies->count; i++)
+    {
+        total_gm += bodies->gm[i];
+        centre[0] += bodies->gm[i] * bodies->position_x[i];
+        centre[1] += bodies->gm[i] * bodies->position_y[i];
+        centre[2] += bodies->gm[i] * bodies->position_z[i];
+        centre[3] += bodies->gm[i] * bodies->velocity_x[i];
+        centre[4] += bodies->gm[i] * bodies->velocity_y[i];
+        centre[5] += bodies->gm[i] * bodies->velocity_z[i];
+    }
+
+    for (int d = 0; d < 6; d++)
+    {
+        centre[d] /= total_gm;
+    }
+}
+
+// Encke bodies do not pull back on body 0 the way Euler pairs do, so body 0 and the bodies riding on
+// it are moved together to keep the centre of mass coasting from where it was before the step
+void recentre_encke(Body_store *bodies, double before[6], double dt)
+{
+    Encke_state *encke = &bodies->encke;
+    double after[6];
+    double total_gm = 0.0, moved_gm = 0.0;
+
+    centre_of_mass(bodies, after);
+
+    for (int i = 0; i < bodies->count; i++)
+    {
+        total_gm += bodies->gm[i];
+        if (i == 0 || encke->mode[i] == PROPAGATE_ENCKE)
+        {
+            moved_gm += bodies->gm[i];
+        }
+    }
+
+    double shift[6];
+    for (int d = 0; d < 3; d++)
+    {
+        shift[d] = (before[d] + before[3 + d] * dt - after[d]) * total_gm / moved_gm;
+        shift[3 + d] = (before[3 + d] - after[3 + d]) * total_gm / moved_gm;
+    }
+
+    for (int i = 0; i < bodies->count; i++)
+    {
+        if (i == 0 || encke->mode[i] == PROPAGATE_ENCKE)
+        {
+            bodies->position_x[i] += shift[0];
+            bodies->position_y[i] += shift[1];
+            bodies->position_z[i] += shift[2];
+            bodies->velocity_x[i] += shift[3];
+            bodies->velocity_y[i] += shift[4];
+            bodies->velocity_z[i] += shift[5];
+        }
+    }
+}
+
+// semi-implicit Euler on the deviation from the reference conic, body 0 must already be updated
+void update_encke(Body_store *bodies, int i, double dt)
+{
+    Encke_state *encke = &bodies->encke;
+    double *reference = &encke->reference[6 * i];
+    double *deviation = &encke->deviation[6 * i];
+    double mu = bodies->gm[0] + bodies->gm[i];
+
+    // reference conic now
+    double rho[3] = {reference[0], reference[1], reference[2]};
+    double rho_velocity[3] = {reference[3], reference[4], reference[5]};
+    kepler_drift(mu, rho, rho_velocity, encke->elapsed[i]);
+
+    double r[3] = {rho[0] + deviation[0], rho[1] + deviation[1], rho[2] + deviation[2]};
+    double rho_squared = rho[0] * rho[0] + rho[1] * rho[1] + rho[2] * rho[2];
+    double r_squared = r[0] * r[0] + r[1] * r[1] + r[2] * r[2];
+
+    // difference of the two body pulls at rho and r without cancellation, Battin's f(q)
+    double q = (deviation[0] * (deviation[0] - 2 * r[0]) + deviation[1] * (deviation[1] - 2 * r[1]) + deviation[2] * (deviation[2] - 2 * r[2])) / r_squared;
+    double f = -q * (3 + 3 * q + q * q) / (1 + pow(1 + q, 1.5));
+    double rho_scale = mu / (rho_squared * sqrt(rho_squared));
+    double r_scale = mu / (r_squared * sqrt(r_squared));
+
+    double acceleration[3] = {
+        bodies->acceleration_x[i] - bodies->acceleration_x[0],
+        bodies->acceleration_y[i] - bodies->acceleration_y[0],
+        bodies->acceleration_z[i] - bodies->acceleration_z[0]};
+
+    for (int d = 0; d < 3; d++)
+    {
+        double perturbation = acceleration[d] + r_scale * r[d];
+        deviation[3 + d] += (rho_scale * (f * r[d] - deviation[d]) + perturbation) * dt;
+        deviation[d] += deviation[3 + d] * dt;
+    }
+
+    encke->elapsed[i] += dt;
+    rho[0] = reference[0]; rho[1] = reference[1]; rho[2] = reference[2];
+    rho_velocity[0] = reference[3]; rho_velocity[1] = reference[4]; rho_velocity[2] = reference[5];
+    kepler_drift(mu, rho, rho_velocity, encke->elapsed[i]);
+
+    bodies->position_x[i] = bodies->position_x[0] + rho[0] + deviation[0];
+    bodies->position_y[i] = bodies->position_y[0] + rho[1] + deviation[1];
+    bodies->position_z[i] = bodies->position_z[0] + rho[2] + deviation[2];
+    bodies->velocity_x[i] = bodies->velocity_x[0] + rho_velocity[0] + deviation[3];
+    bodies->velocity_y[i] = bodies->velocity_y[0] + rho_velocity[1] + deviation[4];
+    bodies->velocity_z[i] = bodies->velocity_z[0] + rho_velocity[2] + deviation[5];
+
+    double deviation_squared = deviation[0] * deviation[0] + deviation[1] * deviation[1] + deviation[2] * deviation[2];
+    rho_squared = rho[0] * rho[0] + rho[1] * rho[1] + rho[2] * rho[2];
+
+    if (deviation_squared > ENCKE_RECTIFY * ENCKE_RECTIFY * rho_squared)
+    {
+        rectify(bodies, i);
+        encke->rectifications++;
+    }
+}
+
+/*
+    respa
+
+    Multiple time stepping (reversible RESPA, Tuckerman, Berne & Martyna 1992). Every pair force
+    is split by a smooth switch on distance into a near part, which changes quickly and is kicked
+    every delta_time, and a far part, which changes slowly and is kicked once every
+    respa_substeps inner steps. The far part is whatever the selected force solver gives minus the
+    near part, so every solver works. Each piece is a symplectic kick or drift, so the whole step is too.
+
+    The near part is summed over neighbour lists found by walking the octree of the massive bodies,
+    with a margin so they only need building again once some body has moved a good part of it.
+*/
+// allocates the near and far accelerations and works out the first ones
+void start_respa(Body_store *bodies)
+{
+    Respa_state *respa = &bodies->respa;
+    int n = bodies->count;
+
+    if (respa->count != n)
+    {
+        double **arrays[] = {
+            &respa->near_x, &respa->near_y, &respa->near_z, &respa->far_x, &respa->far_y, &respa->far_z,
+            &respa->listed_x, &respa->listed_y, &respa->listed_z};
+
+        for (int i = 0; i < (int)(sizeof(arrays) / sizeof(arrays[0])); i++)
+        {
+            free(*arrays[i]);
+            *arrays[i] = malloc(n * sizeof(double));
+            if (!*arrays[i])
+            {
+                perror("malloc failed");
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        free(respa->first);
+        respa->first = malloc((n + 1) * sizeof(int));
+        if (!respa->first)
+        {
+            perror("malloc failed");
+            exit(EXIT_FAILURE);
+        }
+
+        respa->count = n;
+    }
+
+    build_neighbour_lists(bodies);
+    respa_forces(bodies);
+}
+
+// share of a pair force that counts as near, 1 inside RESPA_SWITCH_START of the cutoff falling smoothly to 0 at it
+double respa_switch(double distance)
+{
+    double start = RESPA_SWITCH_START * respa_cutoff;
+
+    if (distance <= start)
+        return 1.0;
+    if (distance >= respa_cutoff)
+        return 0.0;
+
+    double x = (distance - start) / (respa_cutoff - start);
+    return 1.0 - x * x * x * (10.0 - 15.0 * x + 6.0 * x * x);
+}
+
+// lists the bodies within RESPA_LIST_MARGIN cutoffs of each other by walking an octree. Normally each
+// massive body lists the bodies after it, so every pair is on one list and both its bodies are kicked
+// from there. In reproducible mode every body lists the massive bodies around it and sums its own pulls,
+// as in apply_gravitational_forces_reproducible. The lists are sorted, so the near forces add up in the
+// same order however long ago they were built
+void build_neighbour_lists(Body_store *bodies)
+{
+    Respa_state *respa = &bodies->respa;
+    int n = bodies->count;
+    int rows = reproducible ? n : ((bodies->massive_count < n - 1) ? bodies->massive_count : n - 1);
+    double reach = RESPA_LIST_MARGIN * respa_cutoff;
+    Chunk *root = build_octree(bodies, reproducible ? bodies->massive_count : n);
+
+    // counted first, so every body knows where its list starts
+    OMP_PRAGMA(omp parallel for schedule(dynamic, 64) num_threads(pass_threads(n)))
+    for (int i = 0; i < n; i++)
+    {
+        respa->first[i + 1] = (i < rows) ? chunk_neighbours(root, bodies, i, reach, reproducible ? 0 : i + 1, NULL) : 0;
+    }
+
+    respa->first[0] = 0;
+    for (int i = 0; i < n; i++)
+    {
+        respa->first[i + 1] += respa->first[i];
+    }
+
+    if (respa->first[n] > respa->neighbour_capacity)
+    {
+        respa->neighbour_capacity = 2 * respa->first[n];
+        free(respa->neighbours);
+        respa->neighbours = malloc((size_t)respa->neighbour_capacity * sizeof(int));
+        if (!respa->neighbours)
+        {
+            perror("malloc failed");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    OMP_PRAGMA(omp parallel for schedule(dynamic, 64) num_threads(pass_threads(n)))
+    for (int i = 0; i < rows; i++)
+    {
+        int *list = &respa->neighbours[respa->first[i]];
+        qsort(list, chunk_neighbours(root, bodies, i, reach, reproducible ? 0 : i + 1, list), sizeof(int), compare_ints);
+    }
+
+    memcpy(respa->listed_x, bodies->position_x, n * sizeof(double));
+    memcpy(respa->listed_y, bodies->position_y, n * sizeof(double));
+    memcpy(respa->listed_z, bodies->position_z, n * sizeof(double));
+}
+
+// adds the bodies from lowest on in a chunk that are within reach of the target to found, or only counts
+// them if found is NULL
+int chunk_neighbours(Chunk *chunk, Body_store *bodies, int target, double reach, int lowest, int *found)
+{
+    Octree *octree = &bodies->octree;
+    Vec3 p = {bodies->position_x[target], bodies->position_y[target], bodies->position_z[target]};
+
+    // distance to the nearest point of the chunk's cube
+    double gap_x = fmax(fabs(p.x - chunk->centre.x) - chunk->half_size, 0.0);
+    double gap_y = fmax(fabs(p.y - chunk->centre.y) - chunk->half_size, 0.0);
+    double gap_z = fmax(fabs(p.z - chunk->centre.z) - chunk->half_size, 0.0);
+
+    if (gap_x * gap_x + gap_y * gap_y + gap_z * gap_z >= reach * reach)
+        return 0;
+
+    int count = 0;
+
+    if (chunk->leaf)
+    {
+        for (int k = chunk->first; k < chunk->first + chunk->count; k++)
+        {
+            int j = octree->order[k];
+            double dx = bodies->position_x[j] - p.x;
+            double dy = bodies->position_y[j] - p.y;
+            double dz = bodies->position_z[j] - p.z;
+
+            if (j < lowest || j == target || dx * dx + dy * dy + dz * dz >= reach * reach)
+                continue;
+
+            if (found)
+            {
+                found[count] = j;
+            }
+            count++;
+        }
+
+        return count;
+    }
+
+    for (int x = 0; x < 2; x++)
+        for (int y = 0; y < 2; y++)
+            for (int z = 0; z < 2; z++)
+            {
+                if (chunk->child[x][y][z] != NULL)
+                {
+                    count += chunk_neighbours(chunk->child[x][y][z], bodies, target, reach, lowest, found ? found + count : NULL);
+                }
+            }
+
+    return count;
+}
+
+// whether a body has moved far enough since the lists were built that a pair now inside the cutoff may be missing
+bool lists_outdated(Body_store *bodies)
+{
+    int n = bodies->count;
+    double limit = (RESPA_LIST_MARGIN - 1.0) * respa_cutoff / 2;
+    double largest = 0.0;
+
+    if (pass_threads(n) > 1)
+    {
+        OMP_PRAGMA(omp parallel for schedule(static) reduction(max : largest) num_threads(thread_count))
+        for (int i = 0; i < n; i++)
+        {
+            largest = fmax(largest, moved_squared(bodies, i));
+        }
+    }
+    else
+    {
+        for (int i = 0; i < n; i++)
+        {
+            largest = fmax(largest, moved_squared(bodies, i));
+        }
+    }
+
+    return largest > limit * limit;
+}
+
+// squared distance a body has moved since the lists were built
+double moved_squared(Body_store *bodies, int i)
+{
+    Respa_state *respa = &bodies->respa;
+    double dx = bodies->position_x[i] - respa->listed_x[i];
+    double dy = bodies->position_y[i] - respa->listed_y[i];
+    double dz = bodies->position_z[i] - respa->listed_z[i];
+
+    return dx * dx + dy * dy + dz * dz;
+}
+
+// near part of the pair forces over the neighbour lists, threaded the same way as the direct pass
+void near_forces(Body_store *bodies)
+{
+    Respa_state *respa = &bodies->respa;
+    int n = bodies->count;
+    bool threaded = pass_threads(n) > 1;
+
+    if (lists_outdated(bodies))
+    {
+        build_neighbour_lists(bodies);
+    }
+
+    // every body sums its own pulls, so the threads need no buffers
+    if (reproducible)
+    {
+        if (threaded)
+        {
+            OMP_PRAGMA(omp parallel for schedule(static) num_threads(thread_count))
+            for (int i = 0; i < n; i++)
+            {
+                near_pull(bodies, i);
+            }
+            return;
+        }
+
+        for (int i = 0; i < n; i++)
+        {
+            near_pull(bodies, i);
+        }
+        return;
+    }
+
+    if (threaded)
+    {
+        near_forces_parallel(bodies, thread_count);
+        return;
+    }
+
+    memset(respa->near_x, 0, n * sizeof(double));
+    memset(respa->near_y, 0, n * sizeof(double));
+    memset(respa->near_z, 0, n * sizeof(double));
+
+    for (int i = 0; i < n; i++)
+    {
+        near_row(bodies, i, respa->near_x, respa->near_y, respa->near_z);
+    }
+}
+
+// near pass with every thread kicking both bodies of a pair in its own buffers, which are then summed
+// body by body, as in apply_gravitational_forces_direct_parallel
+void near_forces_parallel(Body_store *bodies, int threads)
+{
+    Respa_state *respa = &bodies->respa;
+    int n = bodies->count;
+
+    reserve_thread_buffers(bodies, threads);
+
+    OMP_PRAGMA(omp parallel num_threads(threads))
+    {
+        int thread = 0;
+        int team_size = 1;
+#ifdef _OPENMP
+        thread = omp_get_thread_num();
+        team_size = omp_get_num_threads();
+#endif
+        double *ax = &bodies->thread_acceleration[(size_t)thread * 3 * n];
+        double *ay = ax + n;
+        double *az = ay + n;
+
+        memset(ax, 0, 3 * n * sizeof(double));
+
+        OMP_PRAGMA(omp barrier)
+
+        OMP_PRAGMA(omp for schedule(dynamic, 16))
+        for (int i = 0; i < n; i++)
+        {
+            near_row(bodies, i, ax, ay, az);
+        }
+
+        OMP_PRAGMA(omp for schedule(static))
+        for (int j = 0; j < n; j++)
+        {
+            double sum_x = 0.0, sum_y = 0.0, sum_z = 0.0;
+
+            for (int t = 0; t < team_size; t++)
+            {
+                double *buffer = &bodies->thread_acceleration[(size_t)t * 3 * n];
+                sum_x += buffer[j];
+                sum_y += buffer[n + j];
+                sum_z += buffer[2 * n + j];
+            }
+
+            respa->near_x[j] = sum_x;
+            respa->near_y[j] = sum_y;
+            respa->near_z[j] = sum_z;
+        }
+    }
+}
+
+// near part of the pulls between body i and the bodies on its list, kicking both into the given arrays
+void near_row(Body_store *bodies, int i, double *ax, double *ay, double *az)
+{
+    Respa_state *respa = &bodies->respa;
+
+    for (int k = respa->first[i]; k < respa->first[i + 1]; k++)
+    {
+        int j = respa->neighbours[k];
+
+        double rx = bodies->position_x[j] - bodies->position_x[i];
+        double ry = bodies->position_y[j] - bodies->position_y[i];
+        double rz = bodies->position_z[j] - bodies->position_z[i];
+        double distance_squared = rx * rx + ry * ry + rz * rz;
+        double distance = sqrt(distance_squared);
+        double share = respa_switch(distance);
+
+        if (share == 0.0)
+            continue;
+
+        double inverse_cube = share / (distance_squared * distance);
+        double scale_i = bodies->gm[j] * inverse_cube;
+        double scale_j = bodies->gm[i] * inverse_cube;
+
+        ax[i] += scale_i * rx; ay[i] += scale_i * ry; az[i] += scale_i * rz;
+        ax[j] -= scale_j * rx; ay[j] -= scale_j * ry; az[j] -= scale_j * rz;
+    }
+}
+
+// near part of the pulls on body i from the massive bodies on its list, for reproducible mode
+void near_pull(Body_store *bodies, int i)
+{
+    Respa_state *respa = &bodies->respa;
+    double ax = 0.0, ay = 0.0, az = 0.0;
+
+    for (int k = respa->first[i]; k < respa->first[i + 1]; k++)
+    {
+        int j = respa->neighbours[k];
+
+        double rx = bodies->position_x[j] - bodies->position_x[i];
+        double ry = bodies->position_y[j] - bodies->position_y[i];
+        double rz = bodies->position_z[j] - bodies->position_z[i];
+        double distance_squared = rx * rx + ry * ry + rz * rz;
+        double distance = sqrt(distance_squared);
+        double share = respa_switch(distance);
+
+        if (share == 0.0)
+            continue;
+
+        double scale = bodies->gm[j] * (share / (distance_squared * distance));
+
+        ax += scale * rx;
+        ay += scale * ry;
+        az += scale * rz;
+    }
+
+    respa->near_x[i] = ax;
+    respa->near_y[i] = ay;
+    respa->near_z[i] = az;
+}
+
+// splits a full force pass into its near and far parts
+void respa_forces(Body_store *bodies)
+{
+    Respa_state *respa = &bodies->respa;
+
+    near_forces(bodies);
+    apply_gravitational_forces_N(bodies);
+
+    for (int i = 0; i < bodies->count; i++)
+    {
+        respa->far_x[i] = bodies->acceleration_x[i] - respa->near_x[i];
+        respa->far_y[i] = bodies->acceleration_y[i] - respa->near_y[i];
+        respa->far_z[i] = bodies->acceleration_z[i] - respa->near_z[i];
+    }
+}
+
+// changes every velocity by the given accelerations over dt
+void kick_with(Body_store *bodies, double *ax, double *ay, double *az, double dt)
+{
+    for (int i = 0; i < bodies->count; i++)
+    {
+        bodies->velocity_x[i] += ax[i] * dt;
+        bodies->velocity_y[i] += ay[i] * dt;
+        bodies->velocity_z[i] += az[i] * dt;
+    }
+}
+
+// one outer step: half a far kick, leapfrog steps on the near forces, then the other half far kick
+void respa_step(Body_store *bodies, double dt, int substeps)
+{
+    Respa_state *respa = &bodies->respa;
+    double h = dt / substeps;
+
+    kick_with(bodies, respa->far_x, respa->far_y, respa->far_z, dt / 2);
+
+    for (int s = 0; s < substeps; s++)
+    {
+        kick_with(bodies, respa->near_x, respa->near_y, respa->near_z, h / 2);
+        drift(bodies, h);
+
+        if (s == substeps - 1)
+        {
+            respa_forces(bodies);
+        }
+        else
+        {
+            near_forces(bodies);
+        }
+
+        kick_with(bodies, respa->near_x, respa->near_y, respa->near_z, h / 2);
+    }
+
+    kick_with(bodies, respa->far_x, respa->far_y, respa->far_z, dt / 2);
+}
+
+// outer steps of respa_substeps * delta_time, the last one shortened (with fewer substeps) to land exactly
+bool advance_respa(Body_store *bodies, double from, double to)
+{
+    double time = from;
+
+    while (time < to)
+    {
+        double dt = fmin((double)respa_substeps * delta_time, to - time);
+        int substeps = (int)ceil(dt / delta_time - 1e-9);
+
+        respa_step(bodies, dt, (substeps < 1) ? 1 : substeps);
+        time += dt;
+    }
+
+    return true;
+}
+
+/*
+    hermite
+
+    Fourth order Hermite predictor-corrector with hierarchical block time steps. Every body
+    keeps its own step, a power of two fraction of block_step_max, so slow bodies take long
+    steps while bodies in tight orbits take short ones. Times are counted in integer ticks of
+    block_step_max / 2^MAX_BLOCK_LEVEL so the block boundaries line up exactly.
+
+    The body store positions and velocities hold every body predicted to the current time,
+    the corrected state of each body at its own time is kept in bodies->blocks.
+*/
+// allocates the block step state and starts every body at time 0
+void init_block_steps(Body_store *bodies)
+{
+    Block_steps *blocks = &bodies->blocks;
+    int n = bodies->count;
+
+    if (blocks->count != n)
+    {
+        double **arrays[] = {
+            &blocks->position_x, &blocks->position_y, &blocks->position_z,
+            &blocks->velocity_x, &blocks->velocity_y, &blocks->velocity_z,
+            &blocks->jerk_x, &blocks->jerk_y, &blocks->jerk_z,
+            &blocks->new_acceleration_x, &blocks->new_acceleration_y, &blocks->new_acceleration_z,
+            &blocks->new_jerk_x, &blocks->new_jerk_y, &blocks->new_jerk_z};
+
+        for (int i = 0; i < (int)(sizeof(arrays) / sizeof(arrays[0])); i++)
+        {
+            free(*arrays[i]);
+            *arrays[i] = malloc(n * sizeof(double));
+            if (!*arrays[i])
+            {
+                perror("malloc failed");
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        free(blocks->time);
+        free(blocks->level);
+        free(blocks->active);
+        blocks->time = malloc(n * sizeof(long long));
+        blocks->level = malloc(n * sizeof(int));
+        blocks->active = malloc(n * sizeof(int));
+        if (!blocks->time || !blocks->level || !blocks->active)
+        {
+            perror("malloc failed");
+            exit(EXIT_FAILURE);
+        }
+
+        blocks->count = n;
+    }
+
+    blocks->now = 0;
+    hermite_force_evaluations = 0;
+    blocks->tick = (double)block_step_max / (double)(1LL << MAX_BLOCK_LEVEL);
+
+    // every body is active for the first force pass
+    for (int i = 0; i < n; i++)
+    {
+        blocks->active[i] = i;
+    }
+    hermite_forces(bodies, blocks->active, n);
+
+    for (int i = 0; i < n; i++)
+    {
+        blocks->position_x[i] = bodies->position_x[i];
+        blocks->position_y[i] = bodies->position_y[i];
+        blocks->position_z[i] = bodies->position_z[i];
+        blocks->velocity_x[i] = bodies->velocity_x[i];
+        blocks->velocity_y[i] = bodies->velocity_y[i];
+        blocks->velocity_z[i] = bodies->velocity_z[i];
+
+        bodies->acceleration_x[i] = blocks->new_acceleration_x[i];
+        bodies->acceleration_y[i] = blocks->new_acceleration_y[i];
+        bodies->acceleration_z[i] = blocks->new_acceleration_z[i];
+        blocks->jerk_x[i] = blocks->new_jerk_x[i];
+        blocks->jerk_y[i] = blocks->new_jerk_y[i];
+        blocks->jerk_z[i] = blocks->new_jerk_z[i];
+
+        // no higher derivatives yet, so the first step comes from |a| / |j|
+        double a = sqrt(bodies->acceleration_x[i] * bodies->acceleration_x[i] + bodies->acceleration_y[i] * bodies->acceleration_y[i] + bodies->acceleration_z[i] * bodies->acceleration_z[i]);
+        double j = sqrt(blocks->jerk_x[i] * blocks->jerk_x[i] + blocks->jerk_y[i] * blocks->jerk_y[i] + blocks->jerk_z[i] * blocks->jerk_z[i]);
+        double step = (j > 0) ? HERMITE_START_ACCURACY * a / j : block_step_max;
+
+        blocks->time[i] = 0;
+        blocks->level[i] = block_level(step, 0);
+    }
+}
+
+// deepest power of two level whose step fits inside the wanted step and lines up with the body's time
+int block_level(double step, long long time)
+{
+    int level = 0;
+
+    while (level < MAX_BLOCK_LEVEL && (double)block_step_max / (double)(1LL << level) > step)
+    {
+        level++;
+    }
+
+    // a step can only start on a multiple of its own length
+    while (level < MAX_BLOCK_LEVEL && time % (1LL << (MAX_BLOCK_LEVEL - level)) != 0)
+    {
+        level++;
+    }
+
+    return level;
+}
+
+// acceleration and jerk on the active bodies from every body, using the predicted positions and velocities
+void hermite_forces(Body_store *bodies, int active[], int no_active)
+{
+    Block_steps *blocks = &bodies->blocks;
+
+    // a block is worth threading once it has as many pairs as a direct pass of PARALLEL_MIN_BODIES
+    OMP_PRAGMA(omp parallel for schedule(static) num_threads(pass_threads(no_active * (long long)bodies->count / PARALLEL_MIN_BODIES)))
+    for (int k = 0; k < no_active; k++)
+    {
+        int i = active[k];
+        double ax = 0.0, ay = 0.0, az = 0.0;
+        double jx = 0.0, jy = 0.0, jz = 0.0;
+
+        for (int j = 0; j < bodies->massive_count; j++)
+        {
+            if (j == i)
+                continue;
+
+            double rx = bodies->position_x[j] - bodies->position_x[i];
+            double ry = bodies->position_y[j] - bodies->position_y[i];
+            double rz = bodies->position_z[j] - bodies->position_z[i];
+            double vx = bodies->velocity_x[j] - bodies->velocity_x[i];
+            double vy = bodies->velocity_y[j] - bodies->velocity_y[i];
+            double vz = bodies->velocity_z[j] - bodies->velocity_z[i];
+
+            double distance_squared = rx * rx + ry * ry + rz * rz;
+            double scale = bodies->gm[j] / (distance_squared * sqrt(distance_squared));
+            double rv = 3.0 * (rx * vx + ry * vy + rz * vz) / distance_squared;
+
+            ax += scale * rx;
+            ay += scale * ry;
+            az += scale * rz;
+
+            jx += scale * (vx - rv * rx);
+            jy += scale * (vy - rv * ry);
+            jz += scale * (vz - rv * rz);
+        }
+
+        blocks->new_acceleration_x[i] = ax;
+        blocks->new_acceleration_y[i] = ay;
+        blocks->new_acceleration_z[i] = az;
+        blocks->new_jerk_x[i] = jx;
+        blocks->new_jerk_y[i] = jy;
+        blocks->new_jerk_z[i] = jz;
+    }
+}
+
+// time in ticks at which the next block of bodies finishes its steps
+long long next_block_time(Body_store *bodies)
+{
+    Block_steps *blocks = &bodies->blocks;
+    long long next = -1;
+
+    for (int i = 0; i < bodies->count; i++)
+    {
+        long long end = blocks->time[i] + (1LL << (MAX_BLOCK_LEVEL - blocks->level[i]));
+        if (next < 0 || end < next)
+        {
+            next = end;
+        }
+    }
+
+    return next;
+}
+
+// predicts every body to a time in seconds from its own corrected state, writing into the body store
+void hermite_predict(Body_store *bodies, double time_seconds)
+{
+    Block_steps *blocks = &bodies->blocks;
+
+    for (int i = 0; i < bodies->count; i++)
+    {
+        double dt = time_seconds - blocks->time[i] * blocks->tick;
+        double dt2 = dt * dt / 2;
+        double dt3 = dt2 * dt / 3;
+
+        bodies->position_x[i] = blocks->position_x[i] + blocks->velocity_x[i] * dt + bodies->acceleration_x[i] * dt2 + blocks->jerk_x[i] * dt3;
+        bodies->position_y[i] = blocks->position_y[i] + blocks->velocity_y[i] * dt + bodies->acceleration_y[i] * dt2 + blocks->jerk_y[i] * dt3;
+        bodies->position_z[i] = blocks->position_z[i] + blocks->velocity_z[i] * dt + bodies->acceleration_z[i] * dt2 + blocks->jerk_z[i] * dt3;
+
+        bodies->velocity_x[i] = blocks->velocity_x[i] + bodies->acceleration_x[i] * dt + blocks->jerk_x[i] * dt2;
+        bodies->velocity_y[i] = blocks->velocity_y[i] + bodies->acceleration_y[i] * dt + blocks->jerk_y[i] * dt2;
+        bodies->velocity_z[i] = blocks->velocity_z[i] + bodies->acceleration_z[i] * dt + blocks->jerk_z[i] * dt2;
+    }
+}
+
+// advances the block step system by one block, only the bodies whose steps end first are corrected
+void hermite_step(Body_store *bodies)
+{
+    Block_steps *blocks = &bodies->blocks;
+    int n = bodies->count;
+    int no_active = 0;
+    long long next = next_block_time(bodies);
+
+    for (int i = 0; i < n; i++)
+    {
+        if (blocks->time[i] + (1LL << (MAX_BLOCK_LEVEL - blocks->level[i])) == next)
+        {
+            blocks->active[no_active++] = i;
+        }
+    }
+
+    hermite_predict(bodies, next * blocks->tick);
+    hermite_forces(bodies, blocks->active, no_active);
+
+    for (int k = 0; k < no_active; k++)
+    {
+        int i = blocks->active[k];
+        double h = (double)(1LL << (MAX_BLOCK_LEVEL - blocks->level[i])) * blocks->tick;
+
+        double a0[3] = {bodies->acceleration_x[i], bodies->acceleration_y[i], bodies->acceleration_z[i]};
+        double j0[3] = {blocks->jerk_x[i], blocks->jerk_y[i], blocks->jerk_z[i]};
+        double a1[3] = {blocks->new_acceleration_x[i], blocks->new_acceleration_y[i], blocks->new_acceleration_z[i]};
+        double j1[3] = {blocks->new_jerk_x[i], blocks->new_jerk_y[i], blocks->new_jerk_z[i]};
+        double *position[3] = {&bodies->position_x[i], &bodies->position_y[i], &bodies->position_z[i]};
+        double *velocity[3] = {&bodies->velocity_x[i], &bodies->velocity_y[i], &bodies->velocity_z[i]};
+
+        double snap[3], crackle[3];
+        double a1_squared = 0.0, j1_squared = 0.0, snap_squared = 0.0, crackle_squared = 0.0;
+
+        for (int d = 0; d < 3; d++)
+        {
+            // second and third derivatives of the acceleration at the start of the step from the Hermite interpolant
+            double a2 = (-6.0 * (a0[d] - a1[d]) - h * (4.0 * j0[d] + 2.0 * j1[d])) / (h * h);
+            double a3 = (12.0 * (a0[d] - a1[d]) + 6.0 * h * (j0[d] + j1[d])) / (h * h * h);
+
+            *position[d] += a2 * h * h * h * h / 24.0 + a3 * h * h * h * h * h / 120.0;
+            *velocity[d] += a2 * h * h * h / 6.0 + a3 * h * h * h * h / 24.0;
+
+            snap[d] = a2 + h * a3; // moved to the end of the step
+            crackle[d] = a3;
+
+            a1_squared += a1[d] * a1[d];
+            j1_squared += j1[d] * j1[d];
+            snap_squared += snap[d] * snap[d];
+            crackle_squared += crackle[d] * crackle[d];
+        }
+
+        blocks->position_x[i] = bodies->position_x[i];
+        blocks->position_y[i] = bodies->position_y[i];
+        blocks->position_z[i] = bodies->position_z[i];
+        blocks->velocity_x[i] = bodies->velocity_x[i];
+        blocks->velocity_y[i] = bodies->velocity_y[i];
+        blocks->velocity_z[i] = bodies->velocity_z[i];
+
+        bodies->acceleration_x[i] = a1[0];
+        bodies->acceleration_y[i] = a1[1];
+        bodies->acceleration_z[i] = a1[2];
+        blocks->jerk_x[i] = j1[0];
+        blocks->jerk_y[i] = j1[1];
+        blocks->jerk_z[i] = j1[2];
+
+        blocks->time[i] = next;
+
+        // Aarseth's time step criterion
+        double top = sqrt(a1_squared) * sqrt(snap_squared) + j1_squared;
+        double bottom = sqrt(j1_squared) * sqrt(crackle_squared) + snap_squared;
+        double step = (bottom > 0) ? sqrt(hermite_accuracy * top / bottom) : block_step_max;
+
+        // steps may shrink freely but only grow one level at a time
+        int level = block_level(step, next);
+        if (level < blocks->level[i] - 1)
+        {
+            level = blocks->level[i] - 1;
+        }
+        if (next % (1LL << (MAX_BLOCK_LEVEL - level)) != 0)
+        {
+            level = blocks->level[i];
+        }
+        blocks->level[i] = level;
+    }
+
+    blocks->now = next;
+    hermite_force_evaluations += no_active;
+}
+
+/*
+    simulation log
+*/
+// an empty log for count bodies, the chunks are sized when a run starts
+void init_log(Simulation_log *sim_log, int count)
+{
+    *sim_log = (Simulation_log){0};
+    sim_log->count = count;
+    sim_log->mass = malloc(count * sizeof(double));
+    sim_log->symbol = malloc(count * sizeof(char));
+    sim_log->row = malloc(count * sizeof(Object));
+    if (!sim_log->mass || !sim_log->symbol || !sim_log->row)
+    {
+        perror("malloc failed");
+        exit(EXIT_FAILURE);
+    }
+}
+
+// empties the log for a run of these bodies, in the current log_format. The chunks are kept for
+// the new run unless the format changes their layout
+void start_log(Simulation_log *sim_log, Body_store *bodies)
+{
+    if (sim_log->format != log_format || sim_log->chunk_size == 0)
+    {
+        for (int i = 0; i < sim_log->no_chunks; i++)
+        {
+            VirtualFree(sim_log->chunks[i], 0, MEM_RELEASE);
+        }
+        sim_log->no_chunks = 0;
+        sim_log->format = log_format;
+
+        if (log_format == LOG_CHEBYSHEV)
+        {
+            // room for at least one segment of the highest degree
+            size_t segment_size = (size_t)sim_log->count * 3 * (CHEBYSHEV_DEGREE + 1) * sizeof(double);
+            sim_log->value_size = sizeof(double);
+            sim_log->chunk_rows = 0;
+            sim_log->chunk_size = (segment_size > LOG_CHUNK_SIZE) ? segment_size : LOG_CHUNK_SIZE;
+        }
+        else
+        {
+            sim_log->value_size = (log_format == LOG_FLOAT) ? sizeof(float) : sizeof(double);
+
+            // as many rows to a chunk as fit in LOG_CHUNK_SIZE
+            size_t row_size = LOG_STREAMS * 3 * sim_log->count * sim_log->value_size;
+            sim_log->chunk_rows = (row_size < LOG_CHUNK_SIZE) ? (int)(LOG_CHUNK_SIZE / row_size) : 1;
+            sim_log->chunk_size = LOG_STREAMS * 3 * sim_log->count * sizeof(double) + LOG_STREAMS * log_stream_size(sim_log);
+        }
+    }
+
+    for (int i = 0; i < sim_log->count; i++)
+    {
+        sim_log->mass[i] = bodies->mass[i];
+        sim_log->symbol[i] = bodies->symbol[i];
+    }
+
+    sim_log->rows = 0;
+
+    if (log_format == LOG_CHEBYSHEV)
+    {
+        sim_log->tolerance = log_tolerance;
+        sim_log->no_segments = 0;
+        sim_log->chunk_in_use = 0;
+        sim_log->chunk_used = 0;
+        sim_log->first_pending = 0;
+        sim_log->no_pending = 0;
+
+        if (!sim_log->pending_position)
+        {
+            // fewer rows at once for many bodies, but always enough for a series of the highest degree
+            size_t row_size = (size_t)sim_log->count * 2 * sizeof(Vec3);
+            sim_log->window = (int)(CHEBYSHEV_PENDING_SIZE / row_size);
+            sim_log->window = (sim_log->window < 2 * (CHEBYSHEV_DEGREE + 1)) ? 2 * (CHEBYSHEV_DEGREE + 1) : sim_log->window;
+            sim_log->window = (sim_log->window > CHEBYSHEV_WINDOW) ? CHEBYSHEV_WINDOW : sim_log->window;
+
+            sim_log->pending_position = malloc((size_t)(sim_log->window + 1) * sim_log->count * sizeof(Vec3));
+            sim_log->pending_velocity = malloc((size_t)(sim_log->window + 1) * sim_log->count * sizeof(Vec3));
+            if (!sim_log->pending_position || !sim_log->pending_velocity)
+            {
+                perror("malloc failed");
+                exit(EXIT_FAILURE);
+            }
+        }
+    }
+}
+
+// bytes of one stream in a chunk
+size_t log_stream_size(Simulation_log *sim_log)
+{
+    return (size_t)sim_log->chunk_rows * sim_log->count * 3 * sim_log->value_size;
+}
+
+// a chunk of the log, allocating the chunks up to it if they are not there yet
+char *log_chunk(Simulation_log *sim_log, int chunk)
+{
+    if (chunk >= sim_log->chunk_capacity)
+    {
+        // only the chunk pointers move, never the rows
+        int capacity = (sim_log->chunk_capacity == 0) ? 16 : sim_log->chunk_capacity;
+        while (capacity <= chunk)
+        {
+            capacity *= 2;
+        }
+
+        char **chunks = realloc(sim_log->chunks, capacity * sizeof(char *));
+        if (!chunks)
+        {
+            perror("realloc failed");
+            exit(EXIT_FAILURE);
+        }
+        sim_log->chunks = chunks;
+        sim_log->chunk_capacity = capacity;
+    }
+
+    while (sim_log->no_chunks <= chunk)
+    {
+        // whole pages straight from the system, so growing the log never copies what is in it
+        char *rows = VirtualAlloc(NULL, sim_log->chunk_size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+        if (!rows)
+        {
+            fprintf(stderr, "VirtualAlloc failed\n");
+            exit(EXIT_FAILURE);
+        }
+        sim_log->chunks[sim_log->no_chunks++] = rows;
+    }
+
+    return sim_log->chunks[chunk];
+}
+
+// stores one position or velocity, the first row of a chunk becomes the origin of the floats in it
+void write_log_value(Simulation_log *sim_log, size_t row, int stream, int body, Vec3 value)
+{
+    char *chunk = log_chunk(sim_log, (int)(row / sim_log->chunk_rows));
+    size_t in_chunk = row % sim_log->chunk_rows;
+    size_t at = (in_chunk * sim_log->count + body) * 3;
+    double *origin = (double *)chunk + (stream * sim_log->count + body) * 3;
+    char *values = chunk + LOG_STREAMS * 3 * sim_log->count * sizeof(double) + stream * log_stream_size(sim_log);
+
+    if (sim_log->format == LOG_DOUBLE)
+    {
+        double *stored = (double *)values + at;
+        stored[0] = value.x;
+        stored[1] = value.y;
+        stored[2] = value.z;
+        return;
+    }
+
+    if (in_chunk == 0)
+    {
+        origin[0] = value.x;
+        origin[1] = value.y;
+        origin[2] = value.z;
+    }
+
+    float *stored = (float *)values + at;
+    stored[0] = (float)(value.x - origin[0]);
+    stored[1] = (float)(value.y - origin[1]);
+    stored[2] = (float)(value.z - origin[2]);
+}
+
+// one position or velocity as it was stored
+Vec3 read_log_value(Simulation_log *sim_log, size_t row, int stream, int body)
+{
+    char *chunk = sim_log->chunks[row / sim_log->chunk_rows];
+    size_t at = ((row % sim_log->chunk_rows) * sim_log->count + body) * 3;
+    double *origin = (double *)chunk + (stream * sim_log->count + body) * 3;
+    char *values = chunk + LOG_STREAMS * 3 * sim_log->count * sizeof(double) + stream * log_stream_size(sim_log);
+
+    if (sim_log->format == LOG_DOUBLE)
+    {
+        double *stored = (double *)values + at;
+        return (Vec3){stored[0], stored[1], stored[2]};
+    }
+
+    float *stored = (float *)values + at;
+    return (Vec3){origin[0] + stored[0], origin[1] + stored[1], origin[2] + stored[2]};
+}
+
+// gives every chunk back to the system
+void free_log(Simulation_log *sim_log)
+{
+    for (int i = 0; i < sim_log->no_chunks; i++)
+    {
+        VirtualFree(sim_log->chunks[i], 0, MEM_RELEASE);
+    }
+    free(sim_log->chunks);
+    free(sim_log->mass);
+    free(sim_log->symbol);
+    free(sim_log->row);
+    free(sim_log->segments);
+    free(sim_log->pending_position);
+    free(sim_log->pending_velocity);
+
+    *sim_log = (Simulation_log){0};
+}
+
+// one part of a chunk as it goes in a checkpoint, the origins (part 0) or the rows of one stream as far
+// as the end of the log, and returns its size
+size_t log_chunk_part(Simulation_log *sim_log, int chunk, int part, char **data)
+{
+    size_t origin_size = LOG_STREAMS * 3 * sim_log->count * sizeof(double);
+
+    if (part == 0)
+    {
+        *data = sim_log->chunks[chunk];
+        return origin_size;
+    }
+
+    size_t first = (size_t)chunk * sim_log->chunk_rows;
+    size_t rows = (sim_log->rows - first < (size_t)sim_log->chunk_rows) ? sim_log->rows - first : (size_t)sim_log->chunk_rows;
+
+    *data = sim_log->chunks[chunk] + origin_size + (part - 1) * log_stream_size(sim_log);
+    return rows * sim_log->count * 3 * sim_log->value_size;
+}
+
+// writes all the bodies positions and velocities to the simulation log every log step interval, the
+// rows after it are dropped so a simulation run again from the start writes over the old one
+void update_log(Simulation_log *sim_log, Body_store *bodies, int time_seconds)
+{
+    if (is_interval(log_step, time_seconds))
+    {
+        size_t index = (time_seconds / log_step);
+
+        if (sim_log->format == LOG_CHEBYSHEV)
+        {
+            append_chebyshev_row(sim_log, bodies);
+        }
+        else
+        {
+            for (int i = 0; i < sim_log->count; i++)
+            {
+                write_log_value(sim_log, index, 0, i, (Vec3){bodies->position_x[i], bodies->position_y[i], bodies->position_z[i]});
+                write_log_value(sim_log, index, 1, i, (Vec3){bodies->velocity_x[i], bodies->velocity_y[i], bodies->velocity_z[i]});
+            }
+        }
+
+        sim_log->rows = index + 1;
+    }
+}
+
+// the row logged at a time, times past the end of the log get the last row
+size_t log_index(Simulation_log *sim_log, int time_seconds)
+{
+    size_t index = (time_seconds / log_step);
+
+    if (index >= sim_log->rows)
+    {
+        index = (sim_log->rows > 0) ? sim_log->rows - 1 : 0;
+    }
+
+    return index;
+}
+
+// where a body was and how fast it was moving at any time, interpolated between the logged rows either
+// side of it, or in LOG_CHEBYSHEV from the segment the time is in
+void log_state(Simulation_log *sim_log, int time_seconds, int body, Vec3 *position, Vec3 *velocity)
+{
+    size_t index = log_index(sim_log, time_seconds);
+    int offset = time_seconds - (int)index * log_step; // past the row, 0 on it and after the end of the log
+    bool between = offset > 0 && index + 1 < sim_log->rows;
+
+    if (sim_log->format != LOG_CHEBYSHEV)
+    {
+        *position = read_log_value(sim_log, index, 0, body);
+        *velocity = read_log_value(sim_log, index, 1, body);
+        if (between)
+        {
+            interpolate_rows(position, velocity, read_log_value(sim_log, index + 1, 0, body), read_log_value(sim_log, index + 1, 1, body), offset);
+        }
+        return;
+    }
+
+    // the rows still waiting to be fitted are read as they are
+    if (sim_log->no_segments == 0 || index >= sim_log->first_pending)
+    {
+        size_t at = (index - sim_log->first_pending) * sim_log->count + body;
+        *position = sim_log->pending_position[at];
+        *velocity = sim_log->pending_velocity[at];
+        if (between)
+        {
+            interpolate_rows(position, velocity, sim_log->pending_position[at + sim_log->count], sim_log->pending_velocity[at + sim_log->count], offset);
+        }
+        return;
+    }
+
+    // the last segment starting at or before the time
+    double row = (double)time_seconds / log_step;
+    int low = 0, high = sim_log->no_segments - 1;
+    while (low < high)
+    {
+        int middle = (low + high + 1) / 2;
+        if ((double)sim_log->segments[middle].first_row <= row)
+        {
+            low = middle;
+        }
+        else
+        {
+            high = middle - 1;
+        }
+    }
+
+    chebyshev_state(&sim_log->segments[low], (row < 0.0) ? 0.0 : row, body, position, velocity);
+}
+
+// the cubic through a body's positions and velocities at two rows, at offset seconds past the first. It
+// is exact for anything moving with constant acceleration and far closer than taking the earlier row,
+// so a sparse log still gives smooth frames and trails. The first row's state is replaced with the result
+void interpolate_rows(Vec3 *position, Vec3 *velocity, Vec3 next_position, Vec3 next_velocity, int offset)
+{
+    double h = log_step;
+    double u = (double)offset / log_step;
+    double u2 = u * u, u3 = u2 * u;
+
+    // the Hermite basis and its derivative with respect to u
+    double h00 = 2 * u3 - 3 * u2 + 1, h10 = u3 - 2 * u2 + u, h01 = -2 * u3 + 3 * u2, h11 = u3 - u2;
+    double d00 = 6 * u2 - 6 * u, d10 = 3 * u2 - 4 * u + 1, d01 = -6 * u2 + 6 * u, d11 = 3 * u2 - 2 * u;
+
+    Vec3 p0 = *position, v0 = *velocity;
+
+    position->x = h00 * p0.x + h10 * h * v0.x + h01 * next_position.x + h11 * h * next_velocity.x;
+    position->y = h00 * p0.y + h10 * h * v0.y + h01 * next_position.y + h11 * h * next_velocity.y;
+    position->z = h00 * p0.z + h10 * h * v0.z + h01 * next_position.z + h11 * h * next_velocity.z;
+
+    velocity->x = (d00 * p0.x + d01 * next_position.x) / h + d10 * v0.x + d11 * next_velocity.x;
+    velocity->y = (d00 * p0.y + d01 * next_position.y) / h + d10 * v0.y + d11 * next_velocity.y;
+    velocity->z = (d00 * p0.z + d01 * next_position.z) / h + d10 * v0.z + d11 * next_velocity.z;
+}
+
+// where a body was at a time
+Vec3 log_position(Simulation_log *sim_log, int time_seconds, int body)
+{
+    Vec3 position, velocity;
+
+    log_state(sim_log, time_seconds, body, &position, &velocity);
+    return position;
+}
+
+// how fast a body was moving at a time
+Vec3 log_velocity(Simulation_log *sim_log, int time_seconds, int body)
+{
+    Vec3 position, velocity;
+
+    log_state(sim_log, time_seconds, body, &position, &velocity);
+    return velocity;
+}
+
+// retrieves log data as whole objects, put back together in a row that is only good until the next call
+Object *get_log_data(Simulation_log *sim_log, int time_seconds)
+{
+    for (int i = 0; i < sim_log->count; i++)
+    {
+        Object *object = &sim_log->row[i];
+
+        *object = (Object){0};
+        object->mass = sim_log->mass[i];
+        object->symbol = sim_log->symbol[i];
+        if (sim_log->rows > 0)
+        {
+            log_state(sim_log, time_seconds, i, &object->motion.position, &object->motion.velocity);
+        }
+    }
+
+    return sim_log->row;
+}
+
+/*
+    chebyshev log
+
+    Smooth orbits logged every minute repeat almost the same information row after row. In
+    LOG_CHEBYSHEV the rows are collected until there are a window of them, and then every
+    position is fitted with a least squares Chebyshev series over the window. If any body ends
+    up further than the tolerance from any of its logged positions the window is split in half
+    and each half is fitted again, so close passes get short segments and quiet stretches long
+    ones. All bodies share the segments, so finding one is a binary search on the start rows.
+    The velocities are fitted along with the positions, so they are the derivative of the same
+    series, and positions can be read at any time, not only at logged ones. The last rows of a run wait to be fitted until the window
+    fills, and are read as they were logged until then.
+*/
+// adds a row to the pending ones, fitting them once the window is full
+void append_chebyshev_row(Simulation_log *sim_log, Body_store *bodies)
+{
+    size_t at = (size_t)sim_log->no_pending * sim_log->count;
+
+    for (int i = 0; i < sim_log->count; i++)
+    {
+        sim_log->pending_position[at + i] = (Vec3){bodies->position_x[i], bodies->position_y[i], bodies->position_z[i]};
+        sim_log->pending_velocity[at + i] = (Vec3){bodies->velocity_x[i], bodies->velocity_y[i], bodies->velocity_z[i]};
+    }
+    sim_log->no_pending++;
+
+    if (sim_log->no_pending == sim_log->window + 1)
+    {
+        fit_segments(sim_log, 0, sim_log->window);
+
+        // the last row fitted is the first of the next segment
+        size_t last = (size_t)sim_log->window * sim_log->count;
+        memmove(sim_log->pending_position, &sim_log->pending_position[last], sim_log->count * sizeof(Vec3));
+        memmove(sim_log->pending_velocity, &sim_log->pending_velocity[last], sim_log->count * sizeof(Vec3));
+        sim_log->first_pending += sim_log->window;
+        sim_log->no_pending = 1;
+    }
+}
+
+// fits the pending rows first to last as one segment, or as two halves if it does not come within the tolerance
+void fit_segments(Simulation_log *sim_log, int first, int last)
+{
+    int rows = last - first + 1;
+    int degree = (2 * rows - 1 < CHEBYSHEV_DEGREE) ? 2 * rows - 1 : CHEBYSHEV_DEGREE;
+    int chunk_in_use = sim_log->chunk_in_use;
+    size_t chunk_used = sim_log->chunk_used;
+
+    double *coefficients = log_coefficients(sim_log, (size_t)sim_log->count * 3 * (degree + 1));
+    double error = fit_chebyshev(sim_log, first, rows, degree, coefficients);
+
+    // with as many terms as positions and velocities it goes through every one of them
+    if (error > sim_log->tolerance && 2 * rows > degree + 1)
+    {
+        sim_log->chunk_in_use = chunk_in_use;
+        sim_log->chunk_used = chunk_used;
+
+        int middle = first + (rows - 1) / 2;
+        fit_segments(sim_log, first, middle);
+        fit_segments(sim_log, middle, last);
+        return;
+    }
+
+    add_segment(sim_log, (Log_segment){sim_log->first_pending + first, rows, degree, coefficients});
+}
+
+// puts a segment after the others, only the segment list is ever moved
+void add_segment(Simulation_log *sim_log, Log_segment segment)
+{
+    if (sim_log->no_segments == sim_log->segment_capacity)
+    {
+        int capacity = (sim_log->segment_capacity == 0) ? 64 : sim_log->segment_capacity * 2;
+        Log_segment *segments = realloc(sim_log->segments, capacity * sizeof(Log_segment));
+        if (!segments)
+        {
+            perror("realloc failed");
+            exit(EXIT_FAILURE);
+        }
+        sim_log->segments = segments;
+        sim_log->segment_capacity = capacity;
+    }
+
+    sim_log->segments[sim_log->no_segments++] = segment;
+}
+
+// least squares fit of the pending positions first onwards, and of their velocities times log_step so
+// both are in metres and the derivative is a good velocity too. Returns the furthest a fitted position is
+// from a logged one
+double fit_chebyshev(Simulation_log *sim_log, int first, int rows, int degree, double coefficients[])
+{
+    int terms = degree + 1;
+    int count = sim_log->count;
+    double gram[CHEBYSHEV_DEGREE + 1][CHEBYSHEV_DEGREE + 1] = {0};
+    double t[CHEBYSHEV_DEGREE + 1], dt[CHEBYSHEV_DEGREE + 1];
+
+    memset(coefficients, 0, (size_t)count * 3 * terms * sizeof(double));
+
+    // the normal equations, every body and component has the same left hand side
+    for (int j = 0; j < rows; j++)
+    {
+        chebyshev_terms(-1.0 + 2.0 * j / (rows - 1), degree, t, dt);
+
+        // d/ds times ds per log step
+        for (int k = 0; k < terms; k++)
+        {
+            dt[k] *= 2.0 / (rows - 1);
+        }
+
+        for (int a = 0; a < terms; a++)
+        {
+            for (int b = 0; b <= a; b++)
+            {
+                gram[a][b] += t[a] * t[b] + dt[a] * dt[b];
+            }
+        }
+
+        Vec3 *positions = &sim_log->pending_position[(size_t)(first + j) * count];
+        Vec3 *velocities = &sim_log->pending_velocity[(size_t)(first + j) * count];
+        for (int i = 0; i < count; i++)
+        {
+            double *series = &coefficients[(size_t)i * 3 * terms];
+            Vec3 step = {velocities[i].x * log_step, velocities[i].y * log_step, velocities[i].z * log_step};
+            for (int k = 0; k < terms; k++)
+            {
+                series[k] += t[k] * positions[i].x + dt[k] * step.x;
+                series[terms + k] += t[k] * positions[i].y + dt[k] * step.y;
+                series[2 * terms + k] += t[k] * positions[i].z + dt[k] * step.z;
+            }
+        }
+    }
+
+    // cholesky, the lower triangle is overwritten
+    for (int a = 0; a < terms; a++)
+    {
+        for (int b = 0; b <= a; b++)
+        {
+            double sum = gram[a][b];
+            for (int k = 0; k < b; k++)
+            {
+                sum -= gram[a][k] * gram[b][k];
+            }
+            gram[a][b] = (a == b) ? sqrt(sum) : sum / gram[b][b];
+        }
+    }
+
+    for (size_t series = 0; series < (size_t)count * 3; series++)
+    {
+        double *c = &coefficients[series * terms];
+
+        for (int a = 0; a < terms; a++)
+        {
+            for (int k = 0; k < a; k++)
+            {
+                c[a] -= gram[a][k] * c[k];
+            }
+            c[a] /= gram[a][a];
+        }
+        for (int a = terms - 1; a >= 0; a--)
+        {
+            for (int k = a + 1; k < terms; k++)
+            {
+                c[a] -= gram[k][a] * c[k];
+            }
+            c[a] /= gram[a][a];
+        }
+    }
+
+    double furthest = 0.0;
+    for (int j = 0; j < rows; j++)
+    {
+        chebyshev_terms(-1.0 + 2.0 * j / (rows - 1), degree, t, NULL);
+
+        Vec3 *positions = &sim_log->pending_position[(size_t)(first + j) * count];
+        for (int i = 0; i < count; i++)
+        {
+            double *series = &coefficients[(size_t)i * 3 * terms];
+            double x = 0.0, y = 0.0, z = 0.0;
+            for (int k = 0; k < terms; k++)
+            {
+                x += series[k] * t[k];
+                y += series[terms + k] * t[k];
+                z += series[2 * terms + k] * t[k];
+            }
+
+            x -= positions[i].x;
+            y -= positions[i].y;
+            z -= positions[i].z;
+            furthest = fmax(furthest, sqrt(x * x + y * y + z * z));
+        }
+    }
+
+    return furthest;
+}
+
+// the Chebyshev polynomials T0 .. Tdegree at s in [-1, 1], and their derivatives if asked for, from
+// T'k = k U(k-1) with U the polynomials of the second kind
+void chebyshev_terms(double s, int degree, double terms[], double derivatives[])
+{
+    double u_previous = 0.0, u = 1.0;
+
+    terms[0] = 1.0;
+    if (degree > 0)
+    {
+        terms[1] = s;
+    }
+    for (int k = 2; k <= degree; k++)
+    {
+        terms[k] = 2.0 * s * terms[k - 1] - terms[k - 2];
+    }
+
+    if (!derivatives)
+        return;
+
+    derivatives[0] = 0.0;
+    for (int k = 1; k <= degree; k++)
+    {
+        derivatives[k] = k * u;
+
+        double u_next = 2.0 * s * u - u_previous;
+        u_previous = u;
+        u = u_next;
+    }
+}
+
+// room for count coefficients in the log's chunks, a segment never straddles two
+double *log_coefficients(Simulation_log *sim_log, size_t count)
+{
+    size_t size = count * sizeof(double);
+
+    if (sim_log->chunk_used + size > sim_log->chunk_size)
+    {
+        sim_log->chunk_in_use++;
+        sim_log->chunk_used = 0;
+    }
+
+    double *coefficients = (double *)(log_chunk(sim_log, sim_log->chunk_in_use) + sim_log->chunk_used);
+    sim_log->chunk_used += size;
+
+    return coefficients;
+}
+
+// a body's position and velocity at a row, which need not be a whole one, from the segment it is in
+void chebyshev_state(Log_segment *segment, double row, int body, Vec3 *position, Vec3 *velocity)
+{
+    int terms = segment->degree + 1;
+    double span = segment->rows - 1;
+    double s = -1.0 + 2.0 * (row - (double)segment->first_row) / span;
+    double t[CHEBYSHEV_DEGREE + 1], dt[CHEBYSHEV_DEGREE + 1];
+    double *series = &segment->coefficients[(size_t)body * 3 * terms];
+    double p[3] = {0.0, 0.0, 0.0}, v[3] = {0.0, 0.0, 0.0};
+
+    s = fmin(1.0, fmax(-1.0, s));
+    chebyshev_terms(s, segment->degree, t, dt);
+
+    for (int c = 0; c < 3; c++)
+    {
+        for (int k = 0; k < terms; k++)
+        {
+            p[c] += series[c * terms + k] * t[k];
+            v[c] += series[c * terms + k] * dt[k];
+        }
+    }
+
+    // s covers the segment's span of log steps in 2
+    double scale = 2.0 / (span * log_step);
+    *position = (Vec3){p[0], p[1], p[2]};
+    *velocity = (Vec3){v[0] * scale, v[1] * scale, v[2] * scale};
+}
+
+// copies the segments and the pending rows into a checkpoint buffer and returns their size, or only
+// returns the size with no buffer
+size_t save_chebyshev_log(Simulation_log *sim_log, char *buffer)
+{
+    size_t size = 0;
+
+#define PUT(data, bytes)                              \
+    do                                                \
+    {                                                 \
+        if (buffer)                                   \
+            memcpy(buffer + size, (data), (bytes));   \
+        size += (bytes);                              \
+    } while (0)
+
+    PUT(&sim_log->no_segments, sizeof(int));
+    for (int i = 0; i < sim_log->no_segments; i++)
+    {
+        Log_segment *segment = &sim_log->segments[i];
+        PUT(&segment->first_row, sizeof(size_t));
+        PUT(&segment->rows, sizeof(int));
+        PUT(&segment->degree, sizeof(int));
+        PUT(segment->coefficients, (size_t)sim_log->count * 3 * (segment->degree + 1) * sizeof(double));
+    }
+
+    PUT(&sim_log->first_pending, sizeof(size_t));
+    PUT(&sim_log->no_pending, sizeof(int));
+    PUT(sim_log->pending_position, (size_t)sim_log->no_pending * sim_log->count * sizeof(Vec3));
+    PUT(sim_log->pending_velocity, (size_t)sim_log->no_pending * sim_log->count * sizeof(Vec3));
+#undef PUT
+
+    return size;
+}
+
+// reads back what save_chebyshev_log wrote into an empty log
+void load_chebyshev_log(Simulation_log *sim_log, FILE *file, const char *path)
+{
+    int no_segments;
+
+    read_checkpoint(file, &no_segments, sizeof(int), path);
+    for (int i = 0; i < no_segments; i++)
+    {
+        Log_segment segment;
+        read_checkpoint(file, &segment.first_row, sizeof(size_t), path);
+        read_checkpoint(file, &segment.rows, sizeof(int), path);
+        read_checkpoint(file, &segment.degree, sizeof(int), path);
+        if (segment.degree < 0 || segment.degree > CHEBYSHEV_DEGREE)
+        {
+            fprintf(stderr, "checkpoint %s has a segment this program cannot read\n", path);
+            exit(EXIT_FAILURE);
+        }
+
+        // the same sizes in the same order, so the segments land where they were
+        segment.coefficients = log_coefficients(sim_log, (size_t)sim_log->count * 3 * (segment.degree + 1));
+        read_checkpoint(file, segment.coefficients, (size_t)sim_log->count * 3 * (segment.degree + 1) * sizeof(double), path);
+
+        add_segment(sim_log, segment);
+    }
+
+    read_checkpoint(file, &sim_log->first_pending, sizeof(size_t), path);
+    read_checkpoint(file, &sim_log->no_pending, sizeof(int), path);
+    if (sim_log->no_pending < 0 || sim_log->no_pending > sim_log->window + 1)
+    {
+        fprintf(stderr, "checkpoint %s has a segment this program cannot read\n", path);
+        exit(EXIT_FAILURE);
+    }
+    read_checkpoint(file, sim_log->pending_position, (size_t)sim_log->no_pending * sim_log->count * sizeof(Vec3), path);
+    read_checkpoint(file, sim_log->pending_velocity, (size_t)sim_log->no_pending * sim_log->count * sizeof(Vec3), path);
+}
+
+/*
+    simulation control
+*/
+void simulate(Simulation_log *sim_log, Object initial_objects[], Body_store *bodies, int time_seconds)
+{
+    monitor.refinements = 0;
+    monitor.failed = false;
+    handle_drift(sim_log, initial_objects, bodies, time_seconds, run_simulation(sim_log, initial_objects, bodies, time_seconds));
+}
+
+// runs to a new end time, carrying on from where the bodies are if they were advanced with the current
+// settings so only the new part is integrated. Returns false if it had to start again from the initial objects
+bool extend_simulation(Simulation_log *sim_log, Object initial_objects[], Body_store *bodies, int time_seconds)
+{
+    time_scale = time_seconds;
+
+    Run_settings settings = current_settings();
+    if (!same_run(&bodies->settings, &settings))
+    {
+        simulate(sim_log, initial_objects, bodies, time_seconds);
+        return false;
+    }
+
+    // a shorter run is already in the log
+    monitor.stopped = false;
+    monitor.failed = false;
+    if (time_seconds <= bodies->time)
+        return true;
+
+    handle_drift(sim_log, initial_objects, bodies, time_seconds, continue_simulation(sim_log, initial_objects, bodies, bodies->time, time_seconds));
+    return true;
+}
+
+// runs again with shorter steps while MONITOR_REFINE allows, after a run stopped by drifting at the given time, -1 for none
+void handle_drift(Simulation_log *sim_log, Object initial_objects[], Body_store *bodies, int time_seconds, int drifted)
+{
+    while (drifted >= 0 && !monitor.failed && monitor_action == MONITOR_REFINE && monitor.refinements < MAX_REFINEMENTS && refine_accuracy())
+    {
+        monitor.refinements++;
+        drifted = run_simulation(sim_log, initial_objects, bodies, time_seconds);
+    }
+
+    // nothing past the stopping point was logged, so that is as far as the simulation has run
+    monitor.stopped = drifted >= 0;
+    if (monitor.stopped)
+    {
+        time_scale = drifted;
+    }
+}
+
+// one run from the initial objects, returns the time the energy drift passing drift_threshold or a failing integrator stopped it, or -1
+int run_simulation(Simulation_log *sim_log, Object initial_objects[], Body_store *bodies, int time_seconds)
+{
+    // the log is about to be written over from the start, which a checkpoint may still be saving
+    finish_checkpoint();
+
+    force_passes = 0;
+    load_bodies(bodies, initial_objects);
+    integrators[integrator].start(bodies);
+    start_log(sim_log, bodies);
+    update_log(sim_log, bodies, 0);
+    bodies->time = 0;
+    bodies->settings = current_settings();
+
+    monitor.no_samples = 0;
+    monitor.every = (monitor_step + log_step - 1) / log_step;
+    monitor_sample(bodies, 0);
+
+    return continue_simulation(sim_log, initial_objects, bodies, 0, time_seconds);
+}
+
+// carries a run on from one logged time to another, the same as run_simulation from there on
+int continue_simulation(Simulation_log *sim_log, Object initial_objects[], Body_store *bodies, int from, int to)
+{
+    Integrator *method = &integrators[integrator];
+    int checkpoint_every = (checkpoint_step + log_step - 1) / log_step;
+    int time;
+
+    // run one log step at a time so every integrator lands exactly on the logged times
+    for (time = from + log_step; time <= to; time += log_step)
+    {
+        if (method->advance)
+        {
+            // the bodies are left part way into this log step, so the next run starts again from the initial objects
+            if (!method->advance(bodies, time - log_step, time))
+            {
+                memset(&bodies->settings, 0, sizeof(Run_settings));
+                monitor.failed = true;
+                return time - log_step;
+            }
+        }
+        else
+        {
+            advance_fixed_steps(method->step, bodies, time - log_step, time);
+        }
+
+        update_log(sim_log, bodies, time);
+        bodies->time = time;
+
+        if (is_interval(monitor.every, time / log_step) && monitor_sample(bodies, time) > drift_threshold && monitor_action != MONITOR_SHOW)
+        {
+            return time;
+        }
+
+        if (is_interval(checkpoint_every, time / log_step))
+        {
+            save_checkpoint(sim_log, initial_objects, bodies, time);
+        }
+    }
+
+    // and one at the end, so a finished run can be picked up again as well
+    time -= log_step;
+    if (checkpoint_every > 0 && time > from && !is_interval(checkpoint_every, time / log_step))
+    {
+        save_checkpoint(sim_log, initial_objects, bodies, time);
+    }
+
+    return -1;
+}
+
+// the settings as they are now
+Run_settings current_settings()
+{
+    Run_settings settings;
+
+    // zeroed first so the padding compares equal in same_run
+    memset(&settings, 0, sizeof(settings));
+    settings.delta_time = delta_time;
+    settings.log_step = log_step;
+    settings.time_scale = time_scale;
+    settings.integrator = integrator;
+    settings.force_engine = force_engine;
+    settings.mesh_size = mesh_size;
+    settings.fmm_order = fmm_order;
+    settings.block_step_max = block_step_max;
+    settings.respa_substeps = respa_substeps;
+    settings.opening_angle = opening_angle;
+    settings.test_particle_ratio = test_particle_ratio;
+    settings.hermite_accuracy = hermite_accuracy;
+    settings.radau_accuracy = radau_accuracy;
+    settings.encke_threshold = encke_threshold;
+    settings.respa_cutoff = respa_cutoff;
+    settings.reproducible = reproducible;
+    settings.monitor_step = monitor_step;
+    settings.monitor_action = monitor_action;
+    settings.checkpoint_step = checkpoint_step;
+    settings.drift_threshold = drift_threshold;
+    settings.log_format = log_format;
+    settings.log_tolerance = log_tolerance;
+
+    return settings;
+}
+
+// makes saved settings the current ones
+void apply_settings(Run_settings *settings)
+{
+    delta_time = settings->delta_time;
+    log_step = settings->log_step;
+    time_scale = settings->time_scale;
+    integrator = settings->integrator;
+    force_engine = settings->force_engine;
+    mesh_size = settings->mesh_size;
+    fmm_order = settings->fmm_order;
+    block_step_max = settings->block_step_max;
+    respa_substeps = settings->respa_substeps;
+    opening_angle = settings->opening_angle;
+    test_particle_ratio = settings->test_particle_ratio;
+    hermite_accuracy = settings->hermite_accuracy;
+    radau_accuracy = settings->radau_accuracy;
+    encke_threshold = settings->encke_threshold;
+    respa_cutoff = settings->respa_cutoff;
+    reproducible = settings->reproducible;
+    monitor_step = settings->monitor_step;
+    monitor_action = settings->monitor_action;
+    checkpoint_step = settings->checkpoint_step;
+    drift_threshold = settings->drift_threshold;
+    log_format = settings->log_format;
+    log_tolerance = settings->log_tolerance;
+
+    init_simd();
+}
+
+// whether a run made with one set of settings carries on the same with another, the length of the
+// run and what happens around it (checkpoints and what the monitor does about drift) do not count
+bool same_run(Run_settings *a, Run_settings *b)
+{
+    Run_settings first = *a, second = *b;
+
+    first.time_scale = second.time_scale = 0;
+    first.checkpoint_step = second.checkpoint_step = 0;
+    first.monitor_action = second.monitor_action = 0;
+    first.drift_threshold = second.drift_threshold = 0.0;
+
+    return memcmp(&first, &second, sizeof(Run_settings)) == 0;
+}
+
+/*
+    conservation monitor
+
+    Every monitor_step the total energy, momentum and angular momentum of the massive bodies are
+    compared with their values at the start, which shows whether delta_time is short enough
+    without having to watch the trails. Test particles are left out, they are pulled without
+    pulling back so nothing of theirs is conserved. The potential energy comes from the last
+    force pass, as the sum of m r.a over the bodies is the sum of -G m m / |r| over the pairs for
+    any inverse square force, so a sample costs O(N) instead of another pass over every pair.
+    Integrators that do not finish with a force pass at the final positions get one pass per sample.
+*/
+// makes room for at least count samples
+void reserve_samples(int count)
+{
+    if (count <= monitor.capacity)
+        return;
+
+    int capacity = (monitor.capacity == 0) ? 256 : monitor.capacity;
+    while (capacity < count)
+    {
+        capacity *= 2;
+    }
+
+    Conservation *samples = realloc(monitor.samples, capacity * sizeof(Conservation));
+    if (!samples)
+    {
+        perror("realloc failed");
+        exit(EXIT_FAILURE);
+    }
+    monitor.samples = samples;
+    monitor.capacity = capacity;
+}
+
+// records the conserved totals at this time and returns how far the energy has drifted
+double monitor_sample(Body_store *bodies, int time_seconds)
+{
+    int n = bodies->massive_count;
+
+    if (monitor.no_samples >= monitor.capacity)
+    {
+        reserve_samples(monitor.no_samples + 1);
+    }
+
+    // the integrator's own accelerations are put back afterwards, and the pass is not work it did
+    bool refresh = !integrators[integrator].forces_at_end;
+    long long passes = force_passes;
+    if (refresh)
+    {
+        memcpy(monitor.saved_x, bodies->acceleration_x, bodies->count * sizeof(double));
+        memcpy(monitor.saved_y, bodies->acceleration_y, bodies->count * sizeof(double));
+        memcpy(monitor.saved_z, bodies->acceleration_z, bodies->count * sizeof(double));
+        apply_gravitational_forces_N(bodies);
+    }
+
+    // positions from the centre of mass, which keeps the m r.a sum well conditioned far from the origin
+    double total_mass = 0.0;
+    double centre[3] = {0.0, 0.0, 0.0};
+    for (int i = 0; i < n; i++)
+    {
+        total_mass += bodies->mass[i];
+        centre[0] += bodies->mass[i] * bodies->position_x[i];
+        centre[1] += bodies->mass[i] * bodies->position_y[i];
+        centre[2] += bodies->mass[i] * bodies->position_z[i];
+    }
+    for (int d = 0; d < 3; d++)
+    {
+        centre[d] /= total_mass;
+    }
 
-        // log every log_step
-        update_log(simulation_log, objects, i * delta_time);
+    Conservation *sample = &monitor.samples[monitor.no_samples++];
+    *sample = (Conservation){.time = time_seconds};
+    double kinetic = 0.0, potential = 0.0;
 
-        // render every day
-        if (is_interval(DAY_INTERVAL, i))
+    for (int i = 0; i < n; i++)
+    {
+        double m = bodies->mass[i];
+        double r[3] = {bodies->position_x[i] - centre[0], bodies->position_y[i] - centre[1], bodies->position_z[i] - centre[2]};
+        double v[3] = {bodies->velocity_x[i], bodies->velocity_y[i], bodies->velocity_z[i]};
+        double speed_squared = v[0] * v[0] + v[1] * v[1] + v[2] * v[2];
+
+        kinetic += 0.5 * m * speed_squared;
+        potential += m * (r[0] * bodies->acceleration_x[i] + r[1] * bodies->acceleration_y[i] + r[2] * bodies->acceleration_z[i]);
+
+        for (int d = 0; d < 3; d++)
         {
-            display_time(i * delta_time);
-            render_objects(objects, XY, 1);
-            display_position(objects[0]);
+            sample->momentum[d] += m * v[d];
+        }
+        sample->angular_momentum[0] += m * (r[1] * v[2] - r[2] * v[1]);
+        sample->angular_momentum[1] += m * (r[2] * v[0] - r[0] * v[2]);
+        sample->angular_momentum[2] += m * (r[0] * v[1] - r[1] * v[0]);
+
+        sample->momentum_scale += m * sqrt(speed_squared);
+        sample->angular_scale += m * sqrt(speed_squared * (r[0] * r[0] + r[1] * r[1] + r[2] * r[2]));
+    }
+    sample->energy = kinetic + potential;
+
+    if (refresh)
+    {
+        memcpy(bodies->acceleration_x, monitor.saved_x, bodies->count * sizeof(double));
+        memcpy(bodies->acceleration_y, monitor.saved_y, bodies->count * sizeof(double));
+        memcpy(bodies->acceleration_z, monitor.saved_z, bodies->count * sizeof(double));
+        force_passes = passes;
+    }
+
+    // drifts against the first sample
+    Conservation *first = &monitor.samples[0];
+    double momentum_change = 0.0, angular_change = 0.0;
+    for (int d = 0; d < 3; d++)
+    {
+        momentum_change += pow(sample->momentum[d] - first->momentum[d], 2);
+        angular_change += pow(sample->angular_momentum[d] - first->angular_momentum[d], 2);
+    }
+
+    sample->energy_drift = (first->energy != 0.0) ? fabs((sample->energy - first->energy) / first->energy) : 0.0;
+    sample->momentum_drift = (first->momentum_scale > 0.0) ? sqrt(momentum_change) / first->momentum_scale : 0.0;
+    sample->angular_drift = (first->angular_scale > 0.0) ? sqrt(angular_change) / first->angular_scale : 0.0;
+
+    return sample->energy_drift;
+}
+
+// the last sample taken at or before a time, NULL before any
+Conservation *monitor_at(int time_seconds)
+{
+    if (monitor.no_samples == 0 || monitor.every == 0)
+    {
+        return NULL;
+    }
+
+    int index = (time_seconds / log_step) / monitor.every;
+    if (index >= monitor.no_samples)
+    {
+        index = monitor.no_samples - 1;
+    }
+
+    return &monitor.samples[index];
+}
+
+// shortens the steps of the current integrator by about half, false once they cannot get any shorter
+bool refine_accuracy()
+{
+    switch (integrator)
+    {
+    case HERMITE:
+        // block steps go as the square root of the accuracy parameter
+        hermite_accuracy /= 4.0;
+        return true;
+
+    case RADAU:
+        // steps go as the 7th root of the accuracy, see radau_step
+        if (radau_accuracy <= RADAU_FINEST_ACCURACY)
+        {
+            return false;
+        }
+        radau_accuracy = fmax(radau_accuracy / 128.0, RADAU_FINEST_ACCURACY);
+        return true;
+
+    default:
+        if (delta_time <= 1)
+        {
+            return false;
+        }
+        delta_time /= 2;
+        return true;
+    }
+}
+
+/*
+    checkpoints
+
+    Every checkpoint_step the whole state of a run goes to checkpoint_path, so a long run can be
+    picked up again with law_of_gravitationV2 resume <file> instead of starting over from the
+    initial objects. That is the settings, the body store, the selected integrator's state, the
+    conservation samples and the log up to the current time. The state is copied into a buffer
+    and a background thread writes it, while the log rows already written are saved straight
+    from the log as they never change. Each file is written to <file>.tmp and then moved over
+    the last one, so there is always a complete checkpoint even if the program stops mid-write.
+    Files are in the byte order and struct layout of the program that wrote them.
+*/
+// lists the state of a run in file order, the sizes come from the body count and the selected integrator
+int checkpoint_sections(Body_store *bodies, Object initial_objects[], Checkpoint_section sections[])
+{
+    int n = bodies->count;
+    int count = 0;
+
+#define SECTION(pointer, bytes) sections[count++] = (Checkpoint_section){(pointer), (bytes)}
+    SECTION(initial_objects, n * sizeof(Object));
+
+    double *arrays[BODY_STORE_ARRAYS] = {
+        bodies->position_x, bodies->position_y, bodies->position_z,
+        bodies->velocity_x, bodies->velocity_y, bodies->velocity_z,
+        bodies->acceleration_x, bodies->acceleration_y, bodies->acceleration_z,
+        bodies->mass, bodies->gm};
+    for (int i = 0; i < BODY_STORE_ARRAYS; i++)
+    {
+        SECTION(arrays[i], n * sizeof(double));
+    }
+    SECTION(bodies->symbol, n * sizeof(char));
+
+    // only the selected integrator has state, the force solver workspaces are rebuilt every pass
+    Block_steps *blocks = &bodies->blocks;
+    Encke_state *encke = &bodies->encke;
+    Wisdom_holman_state *wisdom_holman = &bodies->wisdom_holman;
+    Respa_state *respa = &bodies->respa;
+
+    switch (integrator)
+    {
+    case EULER:
+        SECTION(encke->mode, n * sizeof(int));
+        SECTION(encke->reference, 6 * n * sizeof(double));
+        SECTION(encke->deviation, 6 * n * sizeof(double));
+        SECTION(encke->elapsed, n * sizeof(double));
+        SECTION(&encke->no_encke, sizeof(encke->no_encke));
+        SECTION(&encke->rectifications, sizeof(encke->rectifications));
+        break;
+
+    case HERMITE:
+    {
+        double *block_arrays[] = {
+            blocks->position_x, blocks->position_y, blocks->position_z,
+            blocks->velocity_x, blocks->velocity_y, blocks->velocity_z,
+            blocks->jerk_x, blocks->jerk_y, blocks->jerk_z,
+            blocks->new_acceleration_x, blocks->new_acceleration_y, blocks->new_acceleration_z,
+            blocks->new_jerk_x, blocks->new_jerk_y, blocks->new_jerk_z};
+        for (int i = 0; i < (int)(sizeof(block_arrays) / sizeof(block_arrays[0])); i++)
+        {
+            SECTION(block_arrays[i], n * sizeof(double));
+        }
+        SECTION(blocks->time, n * sizeof(long long));
+        SECTION(blocks->level, n * sizeof(int));
+        SECTION(&blocks->now, sizeof(blocks->now));
+        SECTION(&blocks->tick, sizeof(blocks->tick));
+        break;
+    }
+
+    case RADAU:
+        SECTION(bodies->radau.block, (size_t)RADAU_ARRAYS * bodies->radau.components * sizeof(double));
+        SECTION(&bodies->radau.step, sizeof(bodies->radau.step));
+        SECTION(&bodies->radau.time, sizeof(bodies->radau.time));
+        SECTION(&bodies->radau.last_step, sizeof(bodies->radau.last_step));
+        break;
+
+    case WISDOM_HOLMAN:
+        SECTION(wisdom_holman->kick_x, n * sizeof(double));
+        SECTION(wisdom_holman->kick_y, n * sizeof(double));
+        SECTION(wisdom_holman->kick_z, n * sizeof(double));
+        break;
+
+    case RESPA:
+        // the neighbour lists are built again on loading, they are sorted so the near forces come out the same
+        SECTION(respa->near_x, n * sizeof(double));
+        SECTION(respa->near_y, n * sizeof(double));
+        SECTION(respa->near_z, n * sizeof(double));
+        SECTION(respa->far_x, n * sizeof(double));
+        SECTION(respa->far_y, n * sizeof(double));
+        SECTION(respa->far_z, n * sizeof(double));
+        break;
+
+    default:
+        break;
+    }
+
+    SECTION(monitor.samples, monitor.no_samples * sizeof(Conservation));
+#undef SECTION
+
+    return count;
+}
+
+// copies the state at a logged time and hands it to a background thread to write
+void save_checkpoint(Simulation_log *sim_log, Object initial_objects[], Body_store *bodies, int time_seconds)
+{
+    Checkpoint_writer *writer = &checkpoint_writer;
+
+    // one write at a time, the buffer is reused
+    finish_checkpoint();
+
+    Checkpoint_header header = {
+        .version = CHECKPOINT_VERSION,
+        .count = bodies->count,
+        .time = time_seconds,
+        .settings = current_settings(),
+        .no_samples = monitor.no_samples, .monitor_every = monitor.every, .refinements = monitor.refinements,
+        .force_passes = force_passes, .hermite_force_evaluations = hermite_force_evaluations};
+    memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+
+    Checkpoint_section sections[MAX_CHECKPOINT_SECTIONS];
+    int no_sections = checkpoint_sections(bodies, initial_objects, sections);
+
+    size_t size = sizeof(header);
+    for (int i = 0; i < no_sections; i++)
+    {
+        size += sections[i].size;
+    }
+    if (sim_log->format == LOG_CHEBYSHEV)
+    {
+        size += save_chebyshev_log(sim_log, NULL);
+    }
+
+    if (size > writer->capacity)
+    {
+        free(writer->buffer);
+        writer->buffer = malloc(size);
+        if (!writer->buffer)
+        {
+            perror("malloc failed");
+            exit(EXIT_FAILURE);
+        }
+        writer->capacity = size;
+    }
+
+    memcpy(writer->buffer, &header, sizeof(header));
+    writer->size = sizeof(header);
+    for (int i = 0; i < no_sections; i++)
+    {
+        memcpy(writer->buffer + writer->size, sections[i].data, sections[i].size);
+        writer->size += sections[i].size;
+    }
+    if (sim_log->format == LOG_CHEBYSHEV)
+    {
+        writer->size += save_chebyshev_log(sim_log, writer->buffer + writer->size);
+    }
+
+    // the chunk list is copied as well, the log may need a longer one while this is written.
+    // A Chebyshev log is small, so it is copied into the buffer whole
+    char **chunks = writer->log.chunks;
+    writer->log = *sim_log;
+    writer->log.rows = (size_t)(time_seconds / log_step) + 1;
+    writer->log.no_chunks = (sim_log->format == LOG_CHEBYSHEV) ? 0 : (int)((writer->log.rows + sim_log->chunk_rows - 1) / sim_log->chunk_rows);
+    if (writer->log.no_chunks > writer->log_chunk_capacity)
+    {
+        free(chunks);
+        chunks = malloc(writer->log.no_chunks * sizeof(char *));
+        if (!chunks)
+        {
+            perror("malloc failed");
+            exit(EXIT_FAILURE);
+        }
+        writer->log_chunk_capacity = writer->log.no_chunks;
+    }
+    memcpy(chunks, sim_log->chunks, writer->log.no_chunks * sizeof(char *));
+    writer->log.chunks = chunks;
+    snprintf(writer->path, sizeof(writer->path), "%s", checkpoint_path);
+
+    // written here instead if no thread can be started
+    writer->thread = CreateThread(NULL, 0, write_checkpoint, NULL, 0, NULL);
+    if (!writer->thread)
+    {
+        write_checkpoint(NULL);
+    }
+}
+
+// writes the buffered checkpoint and the log rows, then moves the file over the last checkpoint
+DWORD WINAPI write_checkpoint(LPVOID parameter)
+{
+    // the thread is given nothing, it writes the one checkpoint_writer
+    (void)parameter;
+    Checkpoint_writer *writer = &checkpoint_writer;
+    char temporary[CHECKPOINT_PATH_LENGTH + sizeof(".tmp")];
+    int length = snprintf(temporary, sizeof(temporary), "%s.tmp", writer->path);
+    if (length < 0 || length >= (int)sizeof(temporary))
+    {
+        writer->failed = true;
+        return 0;
+    }
+
+    FILE *file = fopen(temporary, "wb");
+    bool written = file && fwrite(writer->buffer, 1, writer->size, file) == writer->size;
+
+    for (int i = 0; i < writer->log.no_chunks && written; i++)
+    {
+        for (int part = 0; part <= LOG_STREAMS && written; part++)
+        {
+            char *data;
+            size_t size = log_chunk_part(&writer->log, i, part, &data);
+            written = fwrite(data, 1, size, file) == size;
+        }
+    }
+
+    if (file && fclose(file) != 0)
+    {
+        written = false;
+    }
+
+    writer->failed = !(written && MoveFileExA(temporary, writer->path, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH));
+
+    return 0;
+}
+
+// waits for the checkpoint being written, if there is one
+void finish_checkpoint()
+{
+    Checkpoint_writer *writer = &checkpoint_writer;
+
+    if (!writer->thread)
+        return;
+
+    WaitForSingleObject(writer->thread, INFINITE);
+    CloseHandle(writer->thread);
+    writer->thread = NULL;
+
+    if (writer->failed)
+    {
+        fprintf(stderr, "could not write checkpoint %s\n", writer->path);
+    }
+}
+
+// restores a run from a checkpoint, with the settings it was made with, and returns its log.
+// The integrator is started from the initial objects first so every array it needs exists,
+// then its state is read over the top
+Simulation_log *load_checkpoint(Arena *arena, const char *path, Object **initial_objects, Body_store *bodies)
+{
+    Checkpoint_header header;
+    FILE *file = fopen(path, "rb");
+
+    if (!file || fread(&header, sizeof(header), 1, file) != 1
+        || memcmp(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic)) != 0 || header.version != CHECKPOINT_VERSION)
+    {
+        fprintf(stderr, "%s is not a checkpoint this program can read\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    apply_settings(&header.settings);
+
+    // later checkpoints of this run replace the one it was restored from
+    snprintf(checkpoint_path, sizeof(checkpoint_path), "%s", path);
+
+    Simulation_log *sim_log = init_scenario(arena, header.count, initial_objects, bodies);
+    read_checkpoint(file, *initial_objects, header.count * sizeof(Object), path);
+
+    load_bodies(bodies, *initial_objects);
+    integrators[integrator].start(bodies);
+
+    reserve_samples(header.no_samples);
+    monitor.no_samples = header.no_samples;
+    monitor.every = header.monitor_every;
+    monitor.refinements = header.refinements;
+
+    Checkpoint_section sections[MAX_CHECKPOINT_SECTIONS];
+    int no_sections = checkpoint_sections(bodies, *initial_objects, sections);
 
+    // the initial objects are already in
+    for (int i = 1; i < no_sections; i++)
+    {
+        read_checkpoint(file, sections[i].data, sections[i].size, path);
+    }
+
+    start_log(sim_log, bodies);
+    sim_log->rows = (size_t)(header.time / log_step) + 1;
+    if (sim_log->format == LOG_CHEBYSHEV)
+    {
+        load_chebyshev_log(sim_log, file, path);
+    }
+    for (size_t row = 0; row < sim_log->rows && sim_log->format != LOG_CHEBYSHEV; row += sim_log->chunk_rows)
+    {
+        log_chunk(sim_log, (int)(row / sim_log->chunk_rows));
+        for (int part = 0; part <= LOG_STREAMS; part++)
+        {
+            char *data;
+            size_t size = log_chunk_part(sim_log, (int)(row / sim_log->chunk_rows), part, &data);
+            read_checkpoint(file, data, size, path);
+        }
+    }
+    fclose(file);
+
+    if (integrator == RESPA)
+    {
+        build_neighbour_lists(bodies);
+    }
+
+    force_passes = header.force_passes;
+    hermite_force_evaluations = header.hermite_force_evaluations;
+    bodies->time = header.time;
+    bodies->settings = header.settings;
+
+    return sim_log;
+}
+
+// reads the next part of a checkpoint, stopping the program if the file ends early
+void read_checkpoint(FILE *file, void *data, size_t size, const char *path)
+{
+    if (fread(data, 1, size, file) != size)
+    {
+        fprintf(stderr, "checkpoint %s is cut short\n", path);
+        exit(EXIT_FAILURE);
+    }
+}
+
+/*
+    ensemble
+
+    Runs many variants of one scenario at once for Monte Carlo studies. Every array in the
+    ensemble is [body][lane], so one vector holds the same body in consecutive variants and
+    each pair of bodies is worked out for a whole vector of variants with no shuffling. The
+    lanes are split into blocks that a thread takes through the whole run on its own, small
+    enough to stay in cache. The variants share one simulation log, as if they were the bodies of a
+    single run, so their rows are position and velocity streams like any other log. Every variant
+    is stepped with leapfrog and direct forces, so all the lanes always step together.
+*/
+// sizes the arena for variants copies of a scenario, the first as created and the rest with every
+// position and velocity component changed by up to ensemble_spread of itself
+void load_ensemble(Arena *arena, int scenario, int count, int variants, Ensemble *ensemble)
+{
+    size_t rows = (size_t)(time_scale / log_step) + 1;
+    int lanes = (variants + ENSEMBLE_LANE_WIDTH - 1) / ENSEMBLE_LANE_WIDTH * ENSEMBLE_LANE_WIDTH;
+    size_t size = 0;
+
+    no_objects = count;
+
+    size += 2 * count * sizeof(Object);
+    size += ENSEMBLE_ARRAYS * (size_t)count * lanes * sizeof(double) + count * sizeof(char);
+    size += (ENSEMBLE_ARRAYS + 3) * ARENA_ALIGNMENT;
+
+    init_arena(arena, size);
+
+    Object *objects = arena_alloc(arena, count * sizeof(Object));
+    Object *variant = arena_alloc(arena, count * sizeof(Object));
+    double **arrays[ENSEMBLE_ARRAYS] = {
+        &ensemble->position_x, &ensemble->position_y, &ensemble->position_z,
+        &ensemble->velocity_x, &ensemble->velocity_y, &ensemble->velocity_z,
+        &ensemble->acceleration_x, &ensemble->acceleration_y, &ensemble->acceleration_z,
+        &ensemble->mass, &ensemble->gm};
+
+    for (int i = 0; i < ENSEMBLE_ARRAYS; i++)
+    {
+        *arrays[i] = arena_alloc(arena, (size_t)count * lanes * sizeof(double));
+    }
+    ensemble->symbol = arena_alloc(arena, count * sizeof(char));
+
+    ensemble->count = count;
+    ensemble->variants = variants;
+    ensemble->lanes = lanes;
+
+    create_scenario(objects, scenario, count);
+
+    for (int lane = 0; lane < variants; lane++)
+    {
+        memcpy(variant, objects, count * sizeof(Object));
+        perturb_objects(variant, count, lane);
+
+        for (int i = 0; i < count; i++)
+        {
+            size_t at = (size_t)i * lanes + lane;
+            ensemble->position_x[at] = variant[i].motion.position.x;
+            ensemble->position_y[at] = variant[i].motion.position.y;
+            ensemble->position_z[at] = variant[i].motion.position.z;
+            ensemble->velocity_x[at] = variant[i].motion.velocity.x;
+            ensemble->velocity_y[at] = variant[i].motion.velocity.y;
+            ensemble->velocity_z[at] = variant[i].motion.velocity.z;
+            ensemble->acceleration_x[at] = 0.0;
+            ensemble->acceleration_y[at] = 0.0;
+            ensemble->acceleration_z[at] = 0.0;
+            ensemble->mass[at] = variant[i].mass;
+            ensemble->gm[at] = GRAVITATIONAL_CONSTANT * variant[i].mass;
+        }
+    }
+
+    // the spare lanes repeat the last variant so they never divide by zero
+    for (int lane = variants; lane < lanes; lane++)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            for (int a = 0; a < ENSEMBLE_ARRAYS; a++)
+            {
+                (*arrays[a])[(size_t)i * lanes + lane] = (*arrays[a])[(size_t)i * lanes + variants - 1];
+            }
+        }
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        ensemble->symbol[i] = objects[i].symbol;
+    }
+
+    Simulation_log *ensemble_log = &ensemble->log;
+    init_log(ensemble_log, variants * count);
+    for (int lane = 0; lane < variants; lane++)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            ensemble_log->mass[lane * count + i] = ensemble->mass[(size_t)i * lanes + lane];
+            ensemble_log->symbol[lane * count + i] = ensemble->symbol[i];
+        }
+    }
+
+    // the blocks write their rows at their own pace, which the Chebyshev fitting cannot follow, so
+    // that format logs floats here. start_log takes the masses and symbols from a body store, here
+    // they are already in the log
+    int format = log_format;
+    log_format = (format == LOG_CHEBYSHEV) ? LOG_FLOAT : format;
+    Body_store masses = {.count = variants * count, .mass = ensemble_log->mass, .symbol = ensemble_log->symbol};
+    start_log(ensemble_log, &masses);
+    log_format = format;
+
+    // every chunk is there before the threads start, so writing rows never grows the chunk list
+    log_chunk(ensemble_log, (int)((rows - 1) / ensemble_log->chunk_rows));
+}
+
+// writes the lanes of one block to one row of the ensemble log
+void update_ensemble_log(Ensemble *ensemble, int first, int last, size_t row)
+{
+    int lanes = ensemble->lanes;
+
+    for (int lane = first; lane < last && lane < ensemble->variants; lane++)
+    {
+        for (int i = 0; i < ensemble->count; i++)
+        {
+            size_t at = (size_t)i * lanes + lane;
+            int body = lane * ensemble->count + i;
+
+            write_log_value(&ensemble->log, row, 0, body, (Vec3){ensemble->position_x[at], ensemble->position_y[at], ensemble->position_z[at]});
+            write_log_value(&ensemble->log, row, 1, body, (Vec3){ensemble->velocity_x[at], ensemble->velocity_y[at], ensemble->velocity_z[at]});
+        }
+    }
+}
+
+// one variant at a time, used when the cpu has no vector support
+void ensemble_forces_scalar(Ensemble *ensemble, int first, int last)
+{
+    int n = ensemble->count;
+    size_t lanes = ensemble->lanes;
+
+    for (int i = 0; i < n; i++)
+    {
+        for (int lane = first; lane < last; lane++)
+        {
+            ensemble->acceleration_x[i * lanes + lane] = 0.0;
+            ensemble->acceleration_y[i * lanes + lane] = 0.0;
+            ensemble->acceleration_z[i * lanes + lane] = 0.0;
+        }
+    }
+
+    for (int i = 0; i < n; i++)
+    {
+        for (int j = i + 1; j < n; j++)
+        {
+            for (int lane = first; lane < last; lane++)
+            {
+                size_t a = i * lanes + lane;
+                size_t b = j * lanes + lane;
+
+                double dx = ensemble->position_x[b] - ensemble->position_x[a];
+                double dy = ensemble->position_y[b] - ensemble->position_y[a];
+                double dz = ensemble->position_z[b] - ensemble->position_z[a];
+                double distance_squared = dx * dx + dy * dy + dz * dz;
+                double inverse_cube = 1.0 / (distance_squared * sqrt(distance_squared));
+                double scale_i = ensemble->gm[b] * inverse_cube;
+                double scale_j = ensemble->gm[a] * inverse_cube;
+
+                ensemble->acceleration_x[a] += scale_i * dx;
+                ensemble->acceleration_y[a] += scale_i * dy;
+                ensemble->acceleration_z[a] += scale_i * dz;
+                ensemble->acceleration_x[b] -= scale_j * dx;
+                ensemble->acceleration_y[b] -= scale_j * dy;
+                ensemble->acceleration_z[b] -= scale_j * dz;
+            }
+        }
+    }
+}
+
+#ifdef SIMD_KERNELS
+
+// 2 variants per instruction
+__attribute__((target("sse2")))
+void ensemble_forces_sse2(Ensemble *ensemble, int first, int last)
+{
+    int n = ensemble->count;
+    size_t lanes = ensemble->lanes;
+    __m128d one = _mm_set1_pd(1.0);
+
+    for (int i = 0; i < n; i++)
+    {
+        for (int lane = first; lane < last; lane += 2)
+        {
+            _mm_storeu_pd(&ensemble->acceleration_x[i * lanes + lane], _mm_setzero_pd());
+            _mm_storeu_pd(&ensemble->acceleration_y[i * lanes + lane], _mm_setzero_pd());
+            _mm_storeu_pd(&ensemble->acceleration_z[i * lanes + lane], _mm_setzero_pd());
+        }
+    }
+
+    for (int i = 0; i < n; i++)
+    {
+        for (int j = i + 1; j < n; j++)
+        {
+            for (int lane = first; lane < last; lane += 2)
+            {
+                size_t a = i * lanes + lane;
+                size_t b = j * lanes + lane;
+
+                __m128d dx = _mm_sub_pd(_mm_loadu_pd(&ensemble->position_x[b]), _mm_loadu_pd(&ensemble->position_x[a]));
+                __m128d dy = _mm_sub_pd(_mm_loadu_pd(&ensemble->position_y[b]), _mm_loadu_pd(&ensemble->position_y[a]));
+                __m128d dz = _mm_sub_pd(_mm_loadu_pd(&ensemble->position_z[b]), _mm_loadu_pd(&ensemble->position_z[a]));
+
+                __m128d distance_squared = _mm_add_pd(_mm_add_pd(_mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy)), _mm_mul_pd(dz, dz));
+                __m128d inverse_cube = _mm_div_pd(one, _mm_mul_pd(distance_squared, _mm_sqrt_pd(distance_squared)));
+                __m128d scale_i = _mm_mul_pd(_mm_loadu_pd(&ensemble->gm[b]), inverse_cube);
+                __m128d scale_j = _mm_mul_pd(_mm_loadu_pd(&ensemble->gm[a]), inverse_cube);
+
+                _mm_storeu_pd(&ensemble->acceleration_x[a], _mm_add_pd(_mm_loadu_pd(&ensemble->acceleration_x[a]), _mm_mul_pd(scale_i, dx)));
+                _mm_storeu_pd(&ensemble->acceleration_y[a], _mm_add_pd(_mm_loadu_pd(&ensemble->acceleration_y[a]), _mm_mul_pd(scale_i, dy)));
+                _mm_storeu_pd(&ensemble->acceleration_z[a], _mm_add_pd(_mm_loadu_pd(&ensemble->acceleration_z[a]), _mm_mul_pd(scale_i, dz)));
+                _mm_storeu_pd(&ensemble->acceleration_x[b], _mm_sub_pd(_mm_loadu_pd(&ensemble->acceleration_x[b]), _mm_mul_pd(scale_j, dx)));
+                _mm_storeu_pd(&ensemble->acceleration_y[b], _mm_sub_pd(_mm_loadu_pd(&ensemble->acceleration_y[b]), _mm_mul_pd(scale_j, dy)));
+                _mm_storeu_pd(&ensemble->acceleration_z[b], _mm_sub_pd(_mm_loadu_pd(&ensemble->acceleration_z[b]), _mm_mul_pd(scale_j, dz)));
+            }
+        }
+    }
+}
+
+// 4 variants per instruction
+__attribute__((target("avx2,fma")))
+void ensemble_forces_avx2(Ensemble *ensemble, int first, int last)
+{
+    int n = ensemble->count;
+    size_t lanes = ensemble->lanes;
+    __m256d one = _mm256_set1_pd(1.0);
+
+    for (int i = 0; i < n; i++)
+    {
+        for (int lane = first; lane < last; lane += 4)
+        {
+            _mm256_storeu_pd(&ensemble->acceleration_x[i * lanes + lane], _mm256_setzero_pd());
+            _mm256_storeu_pd(&ensemble->acceleration_y[i * lanes + lane], _mm256_setzero_pd());
+            _mm256_storeu_pd(&ensemble->acceleration_z[i * lanes + lane], _mm256_setzero_pd());
+        }
+    }
+
+    for (int i = 0; i < n; i++)
+    {
+        for (int j = i + 1; j < n; j++)
+        {
+            for (int lane = first; lane < last; lane += 4)
+            {
+                size_t a = i * lanes + lane;
+                size_t b = j * lanes + lane;
+
+                __m256d dx = _mm256_sub_pd(_mm256_loadu_pd(&ensemble->position_x[b]), _mm256_loadu_pd(&ensemble->position_x[a]));
+                __m256d dy = _mm256_sub_pd(_mm256_loadu_pd(&ensemble->position_y[b]), _mm256_loadu_pd(&ensemble->position_y[a]));
+                __m256d dz = _mm256_sub_pd(_mm256_loadu_pd(&ensemble->position_z[b]), _mm256_loadu_pd(&ensemble->position_z[a]));
+
+                __m256d distance_squared = _mm256_fmadd_pd(dz, dz, _mm256_fmadd_pd(dy, dy, _mm256_mul_pd(dx, dx)));
+                __m256d inverse_cube = _mm256_div_pd(one, _mm256_mul_pd(distance_squared, _mm256_sqrt_pd(distance_squared)));
+                __m256d scale_i = _mm256_mul_pd(_mm256_loadu_pd(&ensemble->gm[b]), inverse_cube);
+                __m256d scale_j = _mm256_mul_pd(_mm256_loadu_pd(&ensemble->gm[a]), inverse_cube);
+
+                _mm256_storeu_pd(&ensemble->acceleration_x[a], _mm256_fmadd_pd(scale_i, dx, _mm256_loadu_pd(&ensemble->acceleration_x[a])));
+                _mm256_storeu_pd(&ensemble->acceleration_y[a], _mm256_fmadd_pd(scale_i, dy, _mm256_loadu_pd(&ensemble->acceleration_y[a])));
+                _mm256_storeu_pd(&ensemble->acceleration_z[a], _mm256_fmadd_pd(scale_i, dz, _mm256_loadu_pd(&ensemble->acceleration_z[a])));
+                _mm256_storeu_pd(&ensemble->acceleration_x[b], _mm256_fnmadd_pd(scale_j, dx, _mm256_loadu_pd(&ensemble->acceleration_x[b])));
+                _mm256_storeu_pd(&ensemble->acceleration_y[b], _mm256_fnmadd_pd(scale_j, dy, _mm256_loadu_pd(&ensemble->acceleration_y[b])));
+                _mm256_storeu_pd(&ensemble->acceleration_z[b], _mm256_fnmadd_pd(scale_j, dz, _mm256_loadu_pd(&ensemble->acceleration_z[b])));
+            }
+        }
+    }
+}
+
+// 8 variants per instruction
+__attribute__((target("avx512f")))
+void ensemble_forces_avx512(Ensemble *ensemble, int first, int last)
+{
+    int n = ensemble->count;
+    size_t lanes = ensemble->lanes;
+    __m512d one = _mm512_set1_pd(1.0);
+
+    for (int i = 0; i < n; i++)
+    {
+        for (int lane = first; lane < last; lane += 8)
+        {
+            _mm512_storeu_pd(&ensemble->acceleration_x[i * lanes + lane], _mm512_setzero_pd());
+            _mm512_storeu_pd(&ensemble->acceleration_y[i * lanes + lane], _mm512_setzero_pd());
+            _mm512_storeu_pd(&ensemble->acceleration_z[i * lanes + lane], _mm512_setzero_pd());
+        }
+    }
+
+    for (int i = 0; i < n; i++)
+    {
+        for (int j = i + 1; j < n; j++)
+        {
+            for (int lane = first; lane < last; lane += 8)
+            {
+                size_t a = i * lanes + lane;
+                size_t b = j * lanes + lane;
+
+                __m512d dx = _mm512_sub_pd(_mm512_loadu_pd(&ensemble->position_x[b]), _mm512_loadu_pd(&ensemble->position_x[a]));
+                __m512d dy = _mm512_sub_pd(_mm512_loadu_pd(&ensemble->position_y[b]), _mm512_loadu_pd(&ensemble->position_y[a]));
+                __m512d dz = _mm512_sub_pd(_mm512_loadu_pd(&ensemble->position_z[b]), _mm512_loadu_pd(&ensemble->position_z[a]));
+
+                __m512d distance_squared = _mm512_fmadd_pd(dz, dz, _mm512_fmadd_pd(dy, dy, _mm512_mul_pd(dx, dx)));
+                __m512d inverse_cube = _mm512_div_pd(one, _mm512_mul_pd(distance_squared, _mm512_sqrt_pd(distance_squared)));
+                __m512d scale_i = _mm512_mul_pd(_mm512_loadu_pd(&ensemble->gm[b]), inverse_cube);
+                __m512d scale_j = _mm512_mul_pd(_mm512_loadu_pd(&ensemble->gm[a]), inverse_cube);
+
+                _mm512_storeu_pd(&ensemble->acceleration_x[a], _mm512_fmadd_pd(scale_i, dx, _mm512_loadu_pd(&ensemble->acceleration_x[a])));
+                _mm512_storeu_pd(&ensemble->acceleration_y[a], _mm512_fmadd_pd(scale_i, dy, _mm512_loadu_pd(&ensemble->acceleration_y[a])));
+                _mm512_storeu_pd(&ensemble->acceleration_z[a], _mm512_fmadd_pd(scale_i, dz, _mm512_loadu_pd(&ensemble->acceleration_z[a])));
+                _mm512_storeu_pd(&ensemble->acceleration_x[b], _mm512_fnmadd_pd(scale_j, dx, _mm512_loadu_pd(&ensemble->acceleration_x[b])));
+                _mm512_storeu_pd(&ensemble->acceleration_y[b], _mm512_fnmadd_pd(scale_j, dy, _mm512_loadu_pd(&ensemble->acceleration_y[b])));
+                _mm512_storeu_pd(&ensemble->acceleration_z[b], _mm512_fnmadd_pd(scale_j, dz, _mm512_loadu_pd(&ensemble->acceleration_z[b])));
+            }
         }
+    }
+}
+
+#endif
+
+// one leapfrog step of the lanes of one block
+void ensemble_leapfrog_step(Ensemble *ensemble, int first, int last, double dt)
+{
+    size_t lanes = ensemble->lanes;
 
+    for (int i = 0; i < ensemble->count; i++)
+    {
+        for (size_t at = i * lanes + first; at < i * lanes + last; at++)
+        {
+            ensemble->velocity_x[at] += ensemble->acceleration_x[at] * dt / 2;
+            ensemble->velocity_y[at] += ensemble->acceleration_y[at] * dt / 2;
+            ensemble->velocity_z[at] += ensemble->acceleration_z[at] * dt / 2;
 
-        apply_gravitational_forces_N(objects);
-        update_N(objects);
+            ensemble->position_x[at] += ensemble->velocity_x[at] * dt;
+            ensemble->position_y[at] += ensemble->velocity_y[at] * dt;
+            ensemble->position_z[at] += ensemble->velocity_z[at] * dt;
+        }
     }
 
-    */
-
-    // render_objects(get_log_data(simulation_log, objects, WEEK - (DAY / 2)), XY, 1);
-    free(simulation_log);
+    ensemble_forces(ensemble, first, last);
 
-    return 0;
+    for (int i = 0; i < ensemble->count; i++)
+    {
+        for (size_t at = i * lanes + first; at < i * lanes + last; at++)
+        {
+            ensemble->velocity_x[at] += ensemble->acceleration_x[at] * dt / 2;
+            ensemble->velocity_y[at] += ensemble->acceleration_y[at] * dt / 2;
+            ensemble->velocity_z[at] += ensemble->acceleration_z[at] * dt / 2;
+        }
+    }
 }
 
-/*
-    core physics
-*/
-// calculates the distance between two objects
-double distance(Object object1, Object object2)
+// runs every variant for time_seconds, each thread taking whole blocks of lanes from start to end
+void simulate_ensemble(Ensemble *ensemble, int time_seconds)
 {
-    double distanceX = object1.motion.position.x - object2.motion.position.x;
-    double distanceY = object1.motion.position.y - object2.motion.position.y;
-    double distanceZ = object1.motion.position.z - object2.motion.position.z;
+    int blocks = (ensemble->lanes + ENSEMBLE_BLOCK - 1) / ENSEMBLE_BLOCK;
 
-    return sqrt(distanceX * distanceX + distanceY * distanceY + distanceZ * distanceZ);
-};
+    // the run settings are per thread, so the workers get this thread's copies
+    int interval = log_step;
+    double largest_step = delta_time;
 
-// applies the gravitational forces between two objects
-void apply_gravitational_forces(Object *object1, Object *object2)
-{
-    Vec3 r;
-    r.x = object2->motion.position.x - object1->motion.position.x;
-    r.y = object2->motion.position.y - object1->motion.position.y;
-    r.z = object2->motion.position.z - object1->motion.position.z;
+    OMP_PRAGMA(omp parallel for schedule(dynamic) num_threads(thread_count))
+    for (int block = 0; block < blocks; block++)
+    {
+        int first = block * ENSEMBLE_BLOCK;
+        int last = (first + ENSEMBLE_BLOCK < ensemble->lanes) ? first + ENSEMBLE_BLOCK : ensemble->lanes;
 
-    double distance = sqrt(r.x * r.x + r.y * r.y + r.z * r.z);
-    double force_magnitude = (GRAVITATIONAL_CONSTANT * object1->mass * object2->mass) / (distance * distance);
+        ensemble_forces(ensemble, first, last);
+        update_ensemble_log(ensemble, first, last, 0);
 
-    Vec3 force;
-    force.x = force_magnitude * r.x / distance;
-    force.y = force_magnitude * r.y / distance;
-    force.z = force_magnitude * r.z / distance;
+        // the same steps as advance_fixed_steps, so every log step is landed on exactly
+        for (int time = interval; time <= time_seconds; time += interval)
+        {
+            double elapsed = time - interval;
+
+            while (elapsed < time)
+            {
+                double dt = fmin(largest_step, time - elapsed);
 
-    object1->motion.force.x += force.x;
-    object1->motion.force.y += force.y;
-    object1->motion.force.z += force.z;
+                ensemble_leapfrog_step(ensemble, first, last, dt);
+                elapsed += dt;
+            }
+
+            update_ensemble_log(ensemble, first, last, time / interval);
+        }
+    }
 
-    object2->motion.force.x -= force.x;
-    object2->motion.force.y -= force.y;
-    object2->motion.force.z -= force.z;
+    ensemble->log.rows = (size_t)(time_seconds / interval) + 1;
 }
 
-// applies the gravitational forces between all objects
-void apply_gravitational_forces_N(Object objects[])
+// runs an ensemble from the command line and reports its throughput and how far the variants spread
+void run_ensemble(int scenario, int count, int variants)
 {
+    Arena arena = {0};
+    Ensemble ensemble = {0};
 
-    for (int i = 0; i < NO_OBJECTS; i++)
-    {
-        objects[i].motion.force = (Vec3){0.0f, 0.0f, 0.0f};
-    }
+    load_ensemble(&arena, scenario, count, variants, &ensemble);
+
+    double start = wall_seconds();
+    simulate_ensemble(&ensemble, time_scale);
+    double seconds = wall_seconds() - start;
 
-    for (int i = 0; i < (NO_OBJECTS - 1); i++)
+    double steps = (double)variants * ceil((double)time_scale / delta_time);
+    printf("Ran %d variants of %d objects for %d days in %.2f seconds on %d threads, logging every %d minutes\n",
+           variants, count, time_scale / DAY, seconds, thread_count, log_step / MINUTE);
+    printf("%.3g variant steps per second\n", steps / seconds);
+
+    // how far each object ends up from where it is in the unchanged variant
+    int last = (time_scale / log_step) * log_step;
+    Object *final_objects = get_log_data(&ensemble.log, last);
+    for (int i = 0; i < count && i < 10; i++)
     {
-        for (int j = i + 1; j < NO_OBJECTS; j++)
+        double furthest = 0.0;
+        for (int v = 1; v < variants; v++)
         {
-            apply_gravitational_forces(&objects[i], &objects[j]);
+            furthest = fmax(furthest, distance(final_objects[v * count + i], final_objects[i]));
         }
+        printf("  %c ends up to %.0f km from the unchanged run\n", final_objects[i].symbol, furthest / 1000);
     }
+
+    free_log(&ensemble.log);
+    free(arena.base);
 }
 
 /*
-    state updates
+    parameter sweep
+
+    Runs every combination of a list of delta times, a list of log steps and a number of
+    perturbed variants of a scenario, as a convergence study without going through the menus.
+    Each run is a normal simulate with its own body store, arena and log. The run settings are
+    per thread, so the runs are spread over every core with OpenMP dynamic scheduling, which
+    hands the next run to whichever thread is free first. The longest runs are queued first so
+    no thread is left with a long run at the end.
 */
-// updates the velocity and position of a given object
-void update(Object *object)
+// runs one sweep entry on the calling thread, setting that thread's copies of the run settings first
+void run_sweep_entry(Sweep_run *run, Object base[], int count, int duration)
 {
-    Vec3 acceleration = {
-        object->motion.force.x / object->mass,
-        object->motion.force.y / object->mass,
-        object->motion.force.z / object->mass};
+    Arena arena = {0};
+    Body_store bodies = {0};
+    Object *initial_objects;
+
+    delta_time = run->delta_time;
+    log_step = run->log_step;
+    time_scale = duration;
+    thread_count = 1;
+    checkpoint_step = 0;
+
+    Simulation_log *sim_log = init_scenario(&arena, count, &initial_objects, &bodies);
+    memcpy(initial_objects, base, count * sizeof(Object));
+    perturb_objects(initial_objects, count, run->variant);
+
+    double start = wall_seconds();
+    simulate(sim_log, initial_objects, &bodies, time_scale);
+    run->wall_time = wall_seconds() - start;
+    run->force_passes = (integrator == HERMITE) ? hermite_force_evaluations : force_passes;
+
+    double initial_energy = total_energy(get_log_data(sim_log, 0), count);
+    int last = (time_scale / log_step) * log_step;
+
+    run->energy_drift = 0.0;
+    for (int time = log_step; time <= last; time += log_step)
+    {
+        double drift = fabs((total_energy(get_log_data(sim_log, time), count) - initial_energy) / initial_energy);
+        run->energy_drift = fmax(run->energy_drift, drift);
+    }
+
+    run->final_objects = malloc(count * sizeof(Object));
+    if (!run->final_objects)
+    {
+        perror("malloc failed");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(run->final_objects, get_log_data(sim_log, last), count * sizeof(Object));
+
+    free_bodies(&bodies);
+    free_log(sim_log);
+    free(monitor.samples);
+    monitor = (Monitor){0};
+    free(arena.base);
+}
 
-    object->motion.velocity.x += acceleration.x * delta_time;
-    object->motion.velocity.y += acceleration.y * delta_time;
-    object->motion.velocity.z += acceleration.z * delta_time;
+// longest runs first, the cost of a run is its number of steps
+int compare_sweep_runs(const void *a, const void *b)
+{
+    const Sweep_run *run_a = a, *run_b = b;
 
-    object->motion.position.x += object->motion.velocity.x * delta_time;
-    object->motion.position.y += object->motion.velocity.y * delta_time;
-    object->motion.position.z += object->motion.velocity.z * delta_time;
+    if (run_a->delta_time != run_b->delta_time)
+        return run_a->delta_time - run_b->delta_time;
+    if (run_a->asked_log_step != run_b->asked_log_step)
+        return run_a->asked_log_step - run_b->asked_log_step;
+    return run_a->variant - run_b->variant;
 }
 
-// updates the velocity and position of all objects
-void update_N(Object objects[])
+// runs the whole grid on every core and prints one table, comparing each run's final state with the
+// run of the same variant and log step that has the smallest delta time. Steps are clipped to the log
+// step, so a log step shorter than the delta time is raised to it as the settings menu does
+void run_sweep(int scenario, int count, int delta_times[], int no_delta_times, int log_steps[], int no_log_steps, int variants)
 {
-    for (int i = 0; i < NO_OBJECTS; i++)
+    int no_runs = no_delta_times * no_log_steps * variants;
+    int duration = time_scale;
+    int threads = thread_count;
+    Object *base = malloc(count * sizeof(Object));
+    Sweep_run *runs = calloc(no_runs, sizeof(Sweep_run));
+    if (!base || !runs)
     {
-        update(&objects[i]);
+        perror("malloc failed");
+        exit(EXIT_FAILURE);
     }
-}
 
-/*
-    simulation log
-*/
-// writes all the objects motion data to the simulation log every log step interval
-void update_log(Object *sim_log, Object objects[], int time_seconds)
-{
-    if (is_interval(log_step, time_seconds))
+    create_scenario(base, scenario, count);
+
+    int k = 0;
+    bool raised = false;
+    for (int d = 0; d < no_delta_times; d++)
+        for (int l = 0; l < no_log_steps; l++)
+            for (int v = 0; v < variants; v++)
+            {
+                int log = (log_steps[l] < delta_times[d]) ? delta_times[d] : log_steps[l];
+                raised |= log != log_steps[l];
+                runs[k++] = (Sweep_run){.delta_time = delta_times[d], .log_step = log, .asked_log_step = log_steps[l], .variant = v};
+            }
+
+    qsort(runs, no_runs, sizeof(Sweep_run), compare_sweep_runs);
+
+    double start = wall_seconds();
+
+    OMP_PRAGMA(omp parallel for schedule(dynamic, 1) num_threads(threads))
+    for (int r = 0; r < no_runs; r++)
+    {
+        run_sweep_entry(&runs[r], base, count, duration);
+    }
+
+    double seconds = wall_seconds() - start;
+
+    // the runs are sorted by delta time, so the first match is the reference
+    for (int r = 0; r < no_runs; r++)
     {
-        int index = (time_seconds / log_step);
-        for (int i = 0; i < NO_OBJECTS; i++)
+        Sweep_run *reference = NULL;
+        for (int s = 0; s < no_runs && !reference; s++)
+        {
+            if (runs[s].variant == runs[r].variant && runs[s].asked_log_step == runs[r].asked_log_step)
+                reference = &runs[s];
+        }
+
+        runs[r].final_error = -1.0;
+        if (reference != &runs[r] && (duration / reference->log_step) * reference->log_step != (duration / runs[r].log_step) * runs[r].log_step)
+        {
+            runs[r].final_error = NAN;
+        }
+        else if (reference != &runs[r])
         {
-            sim_log[index * NO_OBJECTS + i].motion = objects[i].motion;
-            sim_log[index * NO_OBJECTS + i].mass = objects[i].mass;
-            sim_log[index * NO_OBJECTS + i].symbol = objects[i].symbol;
+            runs[r].final_error = 0.0;
+            for (int i = 0; i < count; i++)
+            {
+                runs[r].final_error = fmax(runs[r].final_error, distance(runs[r].final_objects[i], reference->final_objects[i]));
+            }
         }
     }
-}
 
-// retrieves log data
-Object *get_log_data(Object *sim_log, int time_seconds)
-{
-    int index = (time_seconds / log_step);
+    printf("%d runs of %d objects over %d days on %d threads in %.2f seconds, %s integrator\n\n",
+           no_runs, count, duration / DAY, threads, seconds, integrators[integrator].name);
+    printf("  delta time   log step   variant   final error (m)   energy drift   force passes   wall time (s)\n");
 
-    return &sim_log[index * NO_OBJECTS];
+    for (int r = 0; r < no_runs; r++)
+    {
+        char error[32];
+        if (runs[r].final_error < 0)
+            snprintf(error, sizeof(error), "reference");
+        else if (isnan(runs[r].final_error))
+            snprintf(error, sizeof(error), "other end time");
+        else
+            snprintf(error, sizeof(error), "%.3e", runs[r].final_error);
+
+        printf("  %9ds  %8ds%c  %7d   %15s   %12.3e   %12lld   %13.3f\n",
+               runs[r].delta_time, runs[r].log_step, (runs[r].log_step != runs[r].asked_log_step) ? '*' : ' ', runs[r].variant, error,
+               runs[r].energy_drift, runs[r].force_passes, runs[r].wall_time);
+
+        free(runs[r].final_objects);
+    }
+
+    if (raised)
+    {
+        printf("\n* raised to the delta time from a shorter log step, the run is compared with those that asked for that one\n");
+    }
+
+    if (integrator == HERMITE)
+    {
+        printf("\nHermite steps every object on its own, so its force passes are object steps\n");
+    }
+
+    free(runs);
+    free(base);
 }
 
-/*
-    simulation control
-*/
-void simulate(Object *sim_log, Object initial_objects[], Object objects[], int time_seconds)
+// reads a comma separated list of positive whole numbers, returning how many were read
+int parse_list(const char *text, int values[], int max)
 {
-    memcpy(objects, initial_objects, NO_OBJECTS * sizeof(objects[0]));
+    int count = 0;
 
-    // i timestep = delta_time
-    for (int i = 0; i < (time_seconds / delta_time) + 1; i++)
+    while (*text && count < max)
     {
+        char *end;
+        long value = strtol(text, &end, 10);
+        if (end == text)
+            break;
 
-        // log every log_step
-        update_log(sim_log, objects, i * delta_time);
+        if (value > 0)
+            values[count++] = (int)value;
 
-        apply_gravitational_forces_N(objects);
-        update_N(objects);
+        text = (*end == ',') ? end + 1 : end;
     }
+
+    return count;
 }
 
 /*
     rendering
 */
 // renders all the objects in ASCII in a given area
-void render_objects_static(Object *sim_log, int time_seconds)
+void render_objects_static(Simulation_log *sim_log, int time_seconds)
 {
 
     Vec3 focused_object_offset = (Vec3){0.0f, 0.0f, 0.0f};
@@ -430,7 +7092,7 @@ void render_objects_static(Object *sim_log, int time_seconds)
     int half_screen_sizeX = camera.no_pixelsX / 2;
     int half_screen_sizeY = camera.no_pixelsY / 2;
 
-    Vec3 display_pixel[NO_OBJECTS];
+    char object_pixels[200][200] = {0}; // symbol of the object drawn at each pixel, 0 if none
 
     Motion_trail trails[200][200] = {0};
     double closest_depth = 0.0;
@@ -439,9 +7101,10 @@ void render_objects_static(Object *sim_log, int time_seconds)
     
     if (view_focused_object >= 0)
     {
-        focused_object_offset.x = -1 * get_log_data(sim_log, time_seconds)[view_focused_object].motion.position.x;
-        focused_object_offset.y = -1 * get_log_data(sim_log, time_seconds)[view_focused_object].motion.position.y;
-        focused_object_offset.z = -1 * get_log_data(sim_log, time_seconds)[view_focused_object].motion.position.z;
+        Vec3 focused_position = log_position(sim_log, time_seconds, view_focused_object);
+        focused_object_offset.x = -1 * focused_position.x;
+        focused_object_offset.y = -1 * focused_position.y;
+        focused_object_offset.z = -1 * focused_position.z;
     }
 
 
@@ -449,7 +7112,8 @@ void render_objects_static(Object *sim_log, int time_seconds)
     bool displayed = false;
     Vec3 unrot_display_position; // perceived location when displaying, unrotated
 
-    for (int i = 0; i < NO_OBJECTS; i++)
+    // backwards so the lowest numbered object wins a shared pixel
+    for (int i = no_objects - 1; i >= 0; i--)
     {
         Vec3 object_position;
         Vec3 rot_display_position; // perceived location when dispalying, rotated
@@ -457,7 +7121,7 @@ void render_objects_static(Object *sim_log, int time_seconds)
         double object_angle_size_x;
         double object_angle_size_y;
 
-        object_position = get_log_data(sim_log, time_seconds)[i].motion.position;
+        object_position = log_position(sim_log, time_seconds, i);
 
         unrot_display_position.x = (object_position.x + focused_object_offset.x) - camera.pivot_position.x;
         unrot_display_position.y = (object_position.y + focused_object_offset.y) - camera.pivot_position.y;
@@ -474,14 +7138,19 @@ void render_objects_static(Object *sim_log, int time_seconds)
 
         if (depth_ratio > 0)
         {
-            display_pixel[i].x = (int)((rot_display_position.x / (camera.pixel_size_x * depth_ratio)) + (half_screen_sizeX));
-            display_pixel[i].y = (int)((camera.no_pixelsY) - ((rot_display_position.y / (camera.pixel_size_y * depth_ratio )) + (half_screen_sizeY)));
+            int pixel_x = (int)((rot_display_position.x / (camera.pixel_size_x * depth_ratio)) + (half_screen_sizeX));
+            int pixel_y = (int)((camera.no_pixelsY) - ((rot_display_position.y / (camera.pixel_size_y * depth_ratio )) + (half_screen_sizeY)));
+
+            if (pixel_x >= 0 && pixel_x < camera.no_pixelsX && pixel_y >= 0 && pixel_y < camera.no_pixelsY)
+            {
+                object_pixels[pixel_x][pixel_y] = sim_log->symbol[i];
+            }
         }
 
     }
     
     
-    char frame[FRAME_BUFFER_SIZE];
+    static char frame[FRAME_BUFFER_SIZE]; // too big for the stack
     int idx = 0;
 
 
@@ -500,6 +7169,14 @@ void render_objects_static(Object *sim_log, int time_seconds)
     idx += sprintf(&frame[idx], "\n\n%s", display_time(time_seconds));
     idx += sprintf(&frame[idx], "\n|   ZOOM: \033[36m%4.3fx\033[0m   ", camera.zoom);
     idx += sprintf(&frame[idx], "|   RESOLUTION: \033[36m%s\033[0m   ", format_number(camera.pixel_size_x / camera.zoom));
+
+    // energy drift in red once it passes the threshold
+    Conservation *sample = monitor_at(time_seconds);
+    if (sample)
+    {
+        idx += sprintf(&frame[idx], "|   DRIFT E: \033[%sm%.1e\033[0m P: \033[36m%.1e\033[0m L: \033[36m%.1e\033[0m   ",
+                       (sample->energy_drift > drift_threshold) ? "31" : "36", sample->energy_drift, sample->momentum_drift, sample->angular_drift);
+    }
     idx += sprintf(&frame[idx], "|   WIDTH: \033[36m%s\033[0m   |", format_number((camera.view_size_y) / camera.zoom));
     idx += sprintf(&frame[idx], "   YAW: \033[36m%3d\033[0m | PITCH: \033[36m%3d\033[0m   |\n", (int)degrees.z % 360, (int)degrees.x % 360);
 
@@ -510,18 +7187,14 @@ void render_objects_static(Object *sim_log, int time_seconds)
         {
             bool drawn = false;
             // Draw objects
-            for (int ob = 0; ob < NO_OBJECTS; ob++)
+            if (object_pixels[x][y] != 0)
             {
-                if (display_pixel[ob].x == x && display_pixel[ob].y == y)
-                {
-                    idx += sprintf(
-                        &frame[idx],
-                        " \033[32m%c\033[0m ",
-                        get_log_data(sim_log, time_seconds)[ob].symbol
-                    );
-                    drawn = true;
-                    break;
-                }
+                idx += sprintf(
+                    &frame[idx],
+                    " \033[32m%c\033[0m ",
+                    object_pixels[x][y]
+                );
+                drawn = true;
             }
 
             // Draw trail with depth coloring
@@ -570,7 +7243,7 @@ void render_objects_static(Object *sim_log, int time_seconds)
 
 
 // extremely inefficient - calculates every single frame
-void calculate_motion_trails(Object *sim_log, int time_seconds, Motion_trail trails[][200], double *closest_depth)
+void calculate_motion_trails(Simulation_log *sim_log, int time_seconds, Motion_trail trails[][200], double *closest_depth)
 {
 
     Vec3 focused_object_offset = (Vec3){0.0f,0.0f,0.0f};
@@ -582,12 +7255,21 @@ void calculate_motion_trails(Object *sim_log, int time_seconds, Motion_trail tra
 
     if (view_focused_object >= 0)
     {
-        focused_object_offset.x = -1 * get_log_data(sim_log, time_seconds)[view_focused_object].motion.position.x;
-        focused_object_offset.y = -1 * get_log_data(sim_log, time_seconds)[view_focused_object].motion.position.y;
-        focused_object_offset.z = -1 * get_log_data(sim_log, time_seconds)[view_focused_object].motion.position.z;
+        Vec3 focused_position = log_position(sim_log, time_seconds, view_focused_object);
+        focused_object_offset.x = -1 * focused_position.x;
+        focused_object_offset.y = -1 * focused_position.y;
+        focused_object_offset.z = -1 * focused_position.z;
+    }
+
+    // trails are sampled by time rather than by row, so a sparse log is filled in between its rows
+    // instead of being drawn as a handful of dots
+    int trail_step = log_step;
+    if (time_scale / log_step < TRAIL_SAMPLES)
+    {
+        trail_step = time_scale / TRAIL_SAMPLES > 1 ? time_scale / TRAIL_SAMPLES : 1;
     }
 
-    for (int i = 0; i < (time_scale / log_step); i++)
+    for (int t = 0; t < time_scale; t += trail_step)
     {
 
         Vec3 orbit_offset = (Vec3){0.0f,0.0f,0.0f};
@@ -597,17 +7279,15 @@ void calculate_motion_trails(Object *sim_log, int time_seconds, Motion_trail tra
         if (motion_relative_to_object >= 0)
         {
             // movement relative to the object
-            orbit_offset.x = (-1 * get_log_data(sim_log, i * log_step)[motion_relative_to_object].motion.position.x) +
-                            get_log_data(sim_log, time_seconds)[motion_relative_to_object].motion.position.x;
-
-            orbit_offset.y = (-1 * get_log_data(sim_log, i * log_step)[motion_relative_to_object].motion.position.y) +
-                            get_log_data(sim_log, time_seconds)[motion_relative_to_object].motion.position.y;
+            Vec3 then = log_position(sim_log, t, motion_relative_to_object);
+            Vec3 now = log_position(sim_log, time_seconds, motion_relative_to_object);
 
-            orbit_offset.z = (-1 * get_log_data(sim_log, i * log_step)[motion_relative_to_object].motion.position.z) +
-                            get_log_data(sim_log, time_seconds)[motion_relative_to_object].motion.position.z;
+            orbit_offset.x = (-1 * then.x) + now.x;
+            orbit_offset.y = (-1 * then.y) + now.y;
+            orbit_offset.z = (-1 * then.z) + now.z;
         }
 
-        for (int j = 0; j < NO_OBJECTS; j++)
+        for (int j = 0; j < no_objects; j++)
         {
             
             Vec3 object_position;
@@ -616,7 +7296,7 @@ void calculate_motion_trails(Object *sim_log, int time_seconds, Motion_trail tra
             double object_angle_size_x;
             double object_angle_size_y;
 
-            object_position = get_log_data(sim_log, i * log_step)[j].motion.position;
+            object_position = log_position(sim_log, t, j);
 
             unrot_display_position.x = (object_position.x + focused_object_offset.x + orbit_offset.x) - camera.pivot_position.x;
             unrot_display_position.y = (object_position.y + focused_object_offset.y + orbit_offset.y) - camera.pivot_position.y;
@@ -641,9 +7321,7 @@ void calculate_motion_trails(Object *sim_log, int time_seconds, Motion_trail tra
                 Vec3 velocity;
                 Vec3 vrot;
 
-                velocity.x = get_log_data(sim_log, i * log_step)[j].motion.velocity.x;
-                velocity.y = get_log_data(sim_log, i * log_step)[j].motion.velocity.y;
-                velocity.z = get_log_data(sim_log, i * log_step)[j].motion.velocity.z;
+                velocity = log_velocity(sim_log, t, j);
 
                 vrot = rotate_z_up(velocity, degrees.z, degrees.x);
 
@@ -705,7 +7383,7 @@ void calculate_motion_trails(Object *sim_log, int time_seconds, Motion_trail tra
 
 
 // interactive version of the advanced renderer at a snapshot
-char render_interactive(Object *sim_log, int time_seconds, bool have_time_control)
+char render_interactive(Simulation_log *sim_log, int time_seconds, bool have_time_control)
 {   
 
     double extra_move = 1;
@@ -861,7 +7539,7 @@ char render_interactive(Object *sim_log, int time_seconds, bool have_time_contro
 }
 
 // interactive version of the advanced renderer over time
-void render_objects_playback(Object *sim_log, int start, int end)
+void render_objects_playback(Simulation_log *sim_log, int start, int end)
 {
     int i = (start / render_step);
     char return_code;
@@ -891,7 +7569,7 @@ void render_objects_playback(Object *sim_log, int start, int end)
 
 }
 
-void rotate_render(Object *sim_log, int time_seconds)
+void rotate_render(Simulation_log *sim_log, int time_seconds)
 {
     for (int i = 0; i < 360; i+= 5)
     {
@@ -983,7 +7661,7 @@ Mat3 create_yaw_matrix(double yaw) {
 // converts the current time in seconds to a human readable time format
 char *display_time(int time_seconds)
 {
-    static char time_str[60];
+    static char time_str[100];
     int days = 0;
     int hours = 0;
     int minutes = 0;
@@ -1051,8 +7729,10 @@ void display_position(Object object)
 
 void display_all_information(Object objects[])
 {
-    for (int i = 0; i < NO_OBJECTS; i++)
+    for (int i = 0; i < no_objects; i++)
     {
+        Vec3 force = object_force(objects, no_objects, i);
+
         printf("\n");
         for (int i = 0; i < 50; i++)
         {
@@ -1079,9 +7759,9 @@ void display_all_information(Object objects[])
         printf("\nz: %s m/s", format_number(objects[i].motion.velocity.z));
 
         printf("\n\nForce:");
-        printf("\nx: %s N", format_number(objects[i].motion.force.x));
-        printf("\ny: %s N", format_number(objects[i].motion.force.y));
-        printf("\nz: %s N\n\n", format_number(objects[i].motion.force.z));
+        printf("\nx: %s N", format_number(force.x));
+        printf("\ny: %s N", format_number(force.y));
+        printf("\nz: %s N\n\n", format_number(force.z));
     }
 };
 
@@ -1096,6 +7776,23 @@ bool is_interval(int interval, int step)
     return step % interval == 0;
 }
 
+// ascending order for qsort
+int compare_ints(const void *a, const void *b)
+{
+    int x = *(const int *)a, y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+// seconds on a wall clock, for timing runs that use more than one thread
+double wall_seconds()
+{
+#ifdef _OPENMP
+    return omp_get_wtime();
+#else
+    return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+
 void clear_input_buffer()
 {
     int c;
@@ -1135,7 +7832,7 @@ void init_camera()
 /*
     ui
 */
-int program_ui(Object *sim_log, Object initial_objects[], Object objects[])
+int program_ui(Simulation_log *sim_log, Object initial_objects[], Body_store *bodies)
 {
     intro();
     int user_choice = 0;
@@ -1150,7 +7847,7 @@ int program_ui(Object *sim_log, Object initial_objects[], Object objects[])
         switch (user_choice)
         {
         case 1:
-            simulation_ui(sim_log, initial_objects, objects);
+            simulation_ui(sim_log, initial_objects, bodies);
             break;
 
         case 2:
@@ -1164,7 +7861,7 @@ int program_ui(Object *sim_log, Object initial_objects[], Object objects[])
     return 0;
 }
 
-int simulation_ui(Object *sim_log, Object initial_objects[], Object objects[])
+int simulation_ui(Simulation_log *sim_log, Object initial_objects[], Body_store *bodies)
 {
     int user_choice;
     int time_seconds, days, hours, minutes;
@@ -1198,9 +7895,52 @@ int simulation_ui(Object *sim_log, Object initial_objects[], Object objects[])
             scanf("%d %d %d", &days, &hours, &minutes);
 
             time_seconds = (days * DAY) + (hours * HOUR) + (minutes * MINUTE);
-            time_scale = time_seconds;
-            simulate(sim_log, initial_objects, objects, time_seconds);
-            printf("\nSimulation successfully ran for %s\n", display_time(time_seconds));
+
+            int previous_time = bodies->time;
+            if (extend_simulation(sim_log, initial_objects, bodies, time_seconds) && previous_time > 0)
+            {
+                if (previous_time >= time_seconds)
+                {
+                    printf("\nThe log already reaches %s, so nothing had to be run", display_time(previous_time));
+                }
+                else
+                {
+                    printf("\nCarried on from %s, as the settings are unchanged", display_time(previous_time));
+                }
+            }
+
+            if (monitor.refinements > 0)
+            {
+                printf("\nThe energy drifted too far, so the steps were shortened %d times", monitor.refinements);
+                printf("\nThe delta time is now: %d seconds", delta_time);
+            }
+
+            if (monitor.failed)
+            {
+                printf("\n%s could not keep to its accuracy, so the simulation stopped after %s\n", integrators[integrator].name, display_time(time_scale));
+            }
+            else if (monitor.stopped)
+            {
+                printf("\nThe energy drifted more than %.1e, so the simulation stopped after %s\n", drift_threshold, display_time(time_scale));
+            }
+            else
+            {
+                printf("\nSimulation successfully ran for %s\n", display_time(time_seconds));
+            }
+
+            if (integrator == HERMITE)
+            {
+                printf("Hermite took %lld object steps\n", hermite_force_evaluations);
+            }
+            else
+            {
+                printf("The simulation took %lld force passes\n", force_passes);
+            }
+
+            if (integrator == EULER && encke_threshold > 0)
+            {
+                printf("Encke orbits were rectified %lld times\n", bodies->encke.rectifications);
+            }
             break;
 
         case 3:
@@ -1277,6 +8017,16 @@ int simulation_settings_ui()
         printf("\nHere are your options:\n");
         printf("  - Adjust delta time (1)\n");
         printf("  - Adjust log step (2)\n");
+        printf("  - Change force solver (3)\n");
+        printf("  - Adjust Barnes-Hut opening angle (4)\n");
+        printf("  - Adjust thread count (5)\n");
+        printf("  - Change integrator (6)\n");
+        printf("  - Adjust test particle mass ratio (7)\n");
+        printf("  - Adjust Encke propagation (8)\n");
+        printf("  - Toggle reproducible forces (9)\n");
+        printf("  - Adjust conservation monitor (10)\n");
+        printf("  - Adjust checkpoints (11)\n");
+        printf("  - Change log format (12)\n");
         printf("  - Return to previous menu (-1)\n");
 
         scanf("%d", &user_choice);
@@ -1326,6 +8076,271 @@ int simulation_settings_ui()
             printf("\nlog step reassigned successfully! log step is: %d seconds\n", log_step);
             break;
 
+        case 3:
+            printf("\nThe force solver decides how the gravitational forces between objects are calculated\n");
+            printf("Direct sums every pair exactly, Barnes-Hut groups far away objects together and is much faster for many objects\n");
+            printf("Particle mesh spreads the objects over a grid, it is the fastest for huge numbers of objects but blurs close passes\n");
+            printf("Fast multipole groups objects on both ends of each pull, its accuracy is set by the expansion order and opening angle\n");
+            printf("The current force solver is: %s", force_engine_names[force_engine]);
+            printf("\nWhat do you want the force solver to be? Direct(0), Barnes-Hut(1), Particle mesh(2) or Fast multipole(3)\n");
+            scanf("%d", &force_engine);
+
+            if (force_engine != BARNES_HUT && force_engine != PARTICLE_MESH && force_engine != FMM)
+            {
+                force_engine = DIRECT;
+            }
+
+            if (force_engine == FMM)
+            {
+                printf("\nThe expansion order is how much detail is kept about each group, higher is more accurate but slower\n");
+                printf("The current expansion order is: %d", fmm_order);
+                printf("\nWhat do you want the expansion order to be? (1 to %d, e.g., 4)\n", MAX_FMM_ORDER);
+                scanf("%d", &fmm_order);
+
+                if (fmm_order < 1 || fmm_order > MAX_FMM_ORDER)
+                {
+                    fmm_order = 4;
+                }
+            }
+
+            if (force_engine == PARTICLE_MESH)
+            {
+                printf("\nThe mesh size is how many grid cells there are along each side, more is sharper but slower\n");
+                printf("The current mesh size is: %d", mesh_size);
+                printf("\nWhat do you want the mesh size to be? (a power of two from 8 to %d, e.g., 64)\n", MAX_MESH_SIZE);
+                scanf("%d", &mesh_size);
+
+                // round down to a power of two in range
+                int power = 8;
+                while (power * 2 <= mesh_size && power * 2 <= MAX_MESH_SIZE)
+                {
+                    power *= 2;
+                }
+                mesh_size = power;
+            }
+
+            printf("\nForce solver changed successfully!\n");
+            break;
+
+        case 4:
+            printf("\nThe opening angle decides when a group of far away objects is treated as a single object by Barnes-Hut\n");
+            printf("and when two groups are close enough that fast multipole has to look inside them\n");
+            printf("Smaller is more accurate but slower, 0 is the same as the direct solver\n");
+            printf("The current opening angle is: %.2f", opening_angle);
+            printf("\nWhat do you want the opening angle to be? (e.g., 0.5)\n");
+            scanf("%lf", &opening_angle);
+
+            if (opening_angle < 0)
+            {
+                opening_angle = 0;
+            }
+
+            printf("\nOpening angle reassigned successfully! Opening angle is: %.2f\n", opening_angle);
+            break;
+
+        case 5:
+            printf("\nThread count refers to how many cpu cores calculate the gravitational forces at once\n");
+#ifdef _OPENMP
+            printf("This computer has %d cores, the current thread count is: %d", omp_get_num_procs(), thread_count);
+            printf("\nWhat do you want the thread count to be? (0 uses every core)\n");
+            scanf("%d", &thread_count);
+
+            if (thread_count <= 0)
+            {
+                thread_count = omp_get_num_procs();
+            }
+
+            printf("\nThread count reassigned successfully! Thread count is: %d\n", thread_count);
+#else
+            printf("This program was built without OpenMP, so the thread count is always 1\n");
+#endif
+            break;
+
+        case 6:
+            printf("\nThe integrator decides how the objects are moved forward in time\n");
+            printf("Euler is the simplest. Leapfrog, Yoshida-4 and Forest-Ruth keep orbits stable with much larger delta times\n");
+            printf("Hermite gives every object its own time step so slow objects take long steps\n");
+            printf("Gauss-Radau changes its time step to stay accurate through close passes\n");
+            printf("Wisdom-Holman follows the orbits around the first object exactly and can take steps of hours\n");
+            printf("RESPA steps the pulls between nearby objects every delta time and far away ones less often\n");
+            printf("The current integrator is: %s", integrators[integrator].name);
+            printf("\nWhat do you want the integrator to be?");
+            for (int i = 0; i < NO_INTEGRATORS; i++)
+            {
+                printf(" %s(%d)", integrators[i].name, i);
+            }
+            printf("\n");
+            scanf("%d", &integrator);
+
+            if (integrator < 0 || integrator >= NO_INTEGRATORS)
+            {
+                integrator = EULER;
+            }
+
+            if (integrator == HERMITE)
+            {
+                printf("\nThe Hermite accuracy decides how short the time steps are, smaller is more accurate but slower\n");
+                printf("The current accuracy is: %.4f", hermite_accuracy);
+                printf("\nWhat do you want the accuracy to be? (e.g., 0.01)\n");
+                scanf("%lf", &hermite_accuracy);
+
+                if (hermite_accuracy <= 0)
+                {
+                    hermite_accuracy = 0.01;
+                }
+            }
+
+            if (integrator == RESPA)
+            {
+                printf("\nRESPA treats pulls between objects closer than the cutoff distance as near\n");
+                printf("The current cutoff is %.0f km and far pulls are updated every %d delta times", respa_cutoff / 1000, respa_substeps);
+                printf("\nWhat do you want the cutoff to be in km, and how many delta times between far updates? (e.g., 100000 10)\n");
+                scanf("%lf %d", &respa_cutoff, &respa_substeps);
+
+                respa_cutoff *= 1000;
+                if (respa_cutoff <= 0)
+                {
+                    respa_cutoff = 1e8;
+                }
+                if (respa_substeps < 1)
+                {
+                    respa_substeps = 1;
+                }
+            }
+
+            if (integrator == RADAU)
+            {
+                printf("\nGauss-Radau picks its own time steps, the accuracy decides how much error each step may have\n");
+                printf("The current accuracy is: %.1e", radau_accuracy);
+                printf("\nWhat do you want the accuracy to be? (e.g., 1e-9)\n");
+                scanf("%lf", &radau_accuracy);
+
+                if (radau_accuracy <= 0)
+                {
+                    radau_accuracy = 1e-9;
+                }
+            }
+
+            printf("\nIntegrator changed successfully!\n");
+            break;
+
+        case 7:
+            printf("\nObjects lighter than this fraction of the heaviest object are test particles\n");
+            printf("Test particles are pulled by the heavy objects but do not pull on anything, which is much faster for many satellites\n");
+            printf("The current mass ratio is: %.1e", test_particle_ratio);
+            printf("\nWhat do you want the mass ratio to be? (0 turns test particles off)\n");
+            scanf("%lf", &test_particle_ratio);
+
+            if (test_particle_ratio < 0)
+            {
+                test_particle_ratio = 0;
+            }
+
+            printf("\nMass ratio reassigned successfully! Mass ratio is: %.1e\n", test_particle_ratio);
+            break;
+
+        case 8:
+            printf("\nWith the Euler integrator, objects in nearly perfect orbits around the first object can follow\n");
+            printf("an exact orbit and only have the small difference from it stepped, allowing much larger delta times\n");
+            printf("An object uses this when the other pulls on it are smaller than this fraction of the first object's pull\n");
+            printf("The current fraction is: %.1e", encke_threshold);
+            printf("\nWhat do you want the fraction to be? (e.g., 0.01, 0 turns it off)\n");
+            scanf("%lf", &encke_threshold);
+
+            if (encke_threshold < 0)
+            {
+                encke_threshold = 0;
+            }
+
+            printf("\nFraction reassigned successfully! Fraction is: %.1e\n", encke_threshold);
+            break;
+
+        case 9:
+            printf("\nWith reproducible forces on, the direct solver gives exactly the same results on any number of threads\n");
+            printf("and on any computer, so runs can be compared digit for digit. It can be up to twice as slow\n");
+            reproducible = !reproducible;
+            init_simd();
+
+            printf("\nReproducible forces are now %s\n", reproducible ? "on" : "off");
+            break;
+
+        case 10:
+            printf("\nThe conservation monitor checks how much the total energy, momentum and angular momentum change\n");
+            printf("as the simulation runs. They should stay the same, so a large change means the delta time is too long\n");
+            printf("The current monitor step is %d seconds and the energy drift threshold is %.1e", monitor_step, drift_threshold);
+            printf("\nHow often should the monitor check? Enter in the format: days hours minutes (e.g., 0 1 0):\n");
+            scanf("%d %d %d", &days, &hours, &minutes);
+
+            time_seconds = (days * DAY) + (hours * HOUR) + (minutes * MINUTE);
+            monitor_step = (time_seconds > 0) ? time_seconds : HOUR;
+
+            printf("\nWhat is the most the energy may drift, as a fraction of itself? (e.g., 1e-6)\n");
+            scanf("%lf", &drift_threshold);
+
+            if (drift_threshold <= 0)
+            {
+                drift_threshold = 1e-6;
+            }
+
+            printf("\nWhat should happen when the drift passes it? Only show it(0), Stop the simulation(1) or Shorten the steps and start again(2)\n");
+            scanf("%d", &monitor_action);
+
+            if (monitor_action != MONITOR_ABORT && monitor_action != MONITOR_REFINE)
+            {
+                monitor_action = MONITOR_SHOW;
+            }
+
+            printf("\nConservation monitor changed successfully!\n");
+            break;
+
+        case 11:
+            printf("\nCheckpoints save the whole simulation to a file as it runs, so a long run that is stopped can carry on\n");
+            printf("from the last one instead of starting again. Start the program with: resume <file> to carry on\n");
+            printf("The current checkpoint step is %d seconds (0 is off) and the file is: %s", checkpoint_step, checkpoint_path);
+            printf("\nHow much simulated time should there be between checkpoints? Enter in the format: days hours minutes (e.g., 1 0 0):\n");
+            scanf("%d %d %d", &days, &hours, &minutes);
+
+            time_seconds = (days * DAY) + (hours * HOUR) + (minutes * MINUTE);
+            checkpoint_step = (time_seconds > 0) ? time_seconds : 0;
+
+            if (checkpoint_step > 0)
+            {
+                printf("\nWhat file should the checkpoints go to? (e.g., simulation.checkpoint)\n");
+                scanf("%259s", checkpoint_path);
+            }
+
+            printf("\nCheckpoints changed successfully!\n");
+            break;
+
+        case 12:
+            printf("\nThe log can keep positions and velocities exactly, or as floats from where each object is at the start\n");
+            printf("of every chunk of the log, which takes half the memory and is still far finer than a pixel. It can also\n");
+            printf("fit smooth curves through them, which takes far less memory again and can be read at any time\n");
+            printf("\nWhich format do you want? Double(0), Float(1) or Curves(2)\n");
+            scanf("%d", &log_format);
+
+            if (log_format != LOG_FLOAT && log_format != LOG_CHEBYSHEV)
+            {
+                log_format = LOG_DOUBLE;
+            }
+
+            if (log_format == LOG_CHEBYSHEV)
+            {
+                double fraction;
+                printf("\nThe current resolution is %.0f metres per pixel", calculate_resolution());
+                printf("\nHow far may the curves be from the simulated positions, as a fraction of it? (e.g., 0.1)\n");
+                scanf("%lf", &fraction);
+
+                if (fraction > 0)
+                {
+                    log_tolerance = fraction * calculate_resolution();
+                }
+                printf("\nThe curves will be within %.0f metres", log_tolerance);
+            }
+
+            printf("\nLog format changed successfully! It is used from the next simulation run\n");
+            break;
+
         default:
             break;
         }
@@ -1358,6 +8373,7 @@ int render_settings_ui()
         case 1:
             printf("\nRender step refers to how often images are displayed\n");
             printf("The current render step is %s meaning that images are displayed at intervals of %s", display_time(render_step), display_time(render_step));
+            printf("\nIt can be finer than the log step, as frames between logged times are interpolated");
             printf("\nWhat do you want the render step to be? Enter in the format: days hours minutes (e.g., 7 0 0):\n");
             scanf("%d %d %d", &days, &hours, &minutes);
             time_seconds = (days * DAY) + (hours * HOUR) + (minutes * MINUTE);